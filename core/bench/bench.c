@@ -0,0 +1,60 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "core/dmg.h"
+
+/*
+ * bench - runs a rom headless for a number of frames & reports how fast the core went
+ *
+ * usage: core_bench <rom_path> [frames] [interpreter|jit] [scanline|fifo]
+ */
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        printf("[!] usage: core_bench <rom_path> [frames] [interpreter|jit] [scanline|fifo]\n");
+        return EXIT_FAILURE;
+    }
+
+    usize frames = argc > 2 ? (usize)atol(argv[2]) : 3600;
+    cpu_backend_t backend = argc > 3 && !strcmp(argv[3], "jit") ? CPU_BACKEND_JIT : CPU_BACKEND_INTERPRETER;
+    ppu_renderer_t renderer = argc > 4 && !strcmp(argv[4], "fifo") ? PPU_RENDERER_FIFO : PPU_RENDERER_SCANLINE;
+
+    rom_t rom;
+    rom_init(&rom, argv[1], "");
+
+    static dmg_t dmg;
+    dmg_init(&dmg, &rom, false, 48000, 2048, backend, renderer);
+
+    static u32 video[LCD_WIDTH * LCD_HEIGHT];
+    dmg_output_t output = {.video = video};
+
+    clock_t start = clock();
+    usize cycles = 0;
+
+    for (usize i = 0; i < frames; i++)
+    {
+        usize frame = dmg.ppu.frame;
+        cycles += dmg_run_frame(&dmg, &output);
+
+        /* each run should end on the next frame, or the timings below aren't per frame */
+        if (dmg.ppu.frame != frame + 1)
+        {
+            printf("[!] run %zu went from frame %zu to %zu\n", i, frame, dmg.ppu.frame);
+            return EXIT_FAILURE;
+        }
+    }
+
+    double seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    printf("%s: %zu frames in %.3fs, %.1f fps, %.1fx realtime (%s, %s)\n",
+           argv[1], frames, seconds, frames / seconds, cycles / seconds / CPU_FREQUENCY,
+           dmg.cpu.backend == CPU_BACKEND_JIT ? "jit" : "interpreter",
+           dmg.ppu.renderer == PPU_RENDERER_FIFO ? "fifo" : "scanline");
+
+    dmg_free(&dmg);
+    rom_free(&rom);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,128 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "core/pixel.h"
+
+/*
+ * pixel_bench - times the pixel kernels the host supports against per-bit decoding, on random tile data
+ *
+ * usage: core_pixel_bench [iterations]
+ */
+
+#define BENCH_TILES 384
+#define BENCH_PIXELS (BENCH_TILES * 64)
+
+static u8 data[BENCH_TILES * 16];
+static u32 palette[4];
+
+static u8 tiles[BENCH_TILES * 64];
+static u8 flipped[BENCH_TILES * 64];
+static u32 expected[BENCH_PIXELS * 2];
+static u32 pixels[BENCH_PIXELS * 2];
+
+/* the masked per-pixel extraction the ppu used before the kernels */
+static void bench_reference(u32 *out)
+{
+    for (usize tile = 0; tile < BENCH_TILES; tile++)
+    {
+        for (u8 y = 0; y < 8; y++)
+        {
+            u8 pixel_line_1 = data[tile * 16 + y * 2 + 1];
+            u8 pixel_line_2 = data[tile * 16 + y * 2 + 0];
+
+            for (u8 x = 0; x < 8; x++)
+            {
+                u8 pixel_mask = 0x80 >> x;
+                u8 pixel = (((pixel_line_1 & pixel_mask) != 0) << 1) | ((pixel_line_2 & pixel_mask) != 0);
+
+                out[tile * 64 + y * 8 + x] = palette[pixel];
+                out[BENCH_PIXELS + tile * 64 + y * 8 + (7 - x)] = palette[pixel];
+            }
+        }
+    }
+}
+
+static void bench_decode(pixel_kernels_t *kernels)
+{
+    for (usize tile = 0; tile < BENCH_TILES; tile++)
+        kernels->decode_tile(&data[tile * 16], &tiles[tile * 64], &flipped[tile * 64]);
+}
+
+static void bench_apply(pixel_kernels_t *kernels, u32 *out)
+{
+    /* a row at a time, as the ppu does */
+    for (usize row = 0; row < BENCH_TILES * 8; row++)
+    {
+        kernels->apply_palette(&tiles[row * 8], palette, &out[row * 8], 8);
+        kernels->apply_palette(&flipped[row * 8], palette, &out[BENCH_PIXELS + row * 8], 8);
+    }
+}
+
+static double bench_time(pixel_kernels_t *kernels, usize iterations, bool decode)
+{
+    clock_t start = clock();
+
+    for (usize i = 0; i < iterations; i++)
+    {
+        if (!kernels)
+            bench_reference(pixels);
+        else if (decode)
+            bench_decode(kernels);
+        else
+            bench_apply(kernels, pixels);
+    }
+
+    return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+int main(int argc, char *argv[])
+{
+    usize iterations = argc > 1 ? (usize)atol(argv[1]) : 2000;
+
+    srand(1);
+    for (usize i = 0; i < sizeof(data); i++)
+        data[i] = rand() & 0xFF;
+    for (usize i = 0; i < 4; i++)
+        palette[i] = 0xFF000000 | (rand() & 0xFFFFFF);
+
+    bench_reference(expected);
+
+    pixel_kernels_t *kernels[] = {
+        &pixel_kernels_scalar,
+#ifdef PIXEL_SIMD
+        &pixel_kernels_sse2,
+        &pixel_kernels_avx2,
+#endif
+    };
+
+    double reference = bench_time(NULL, iterations, false);
+    double megapixels = (double)BENCH_PIXELS * 2 * iterations / 1e6;
+    printf("%-10s %27.1f Mpixel/s\n", "per-bit", megapixels / reference);
+
+    for (usize i = 0; i < sizeof(kernels) / sizeof(kernels[0]); i++)
+    {
+        if (!pixel_supported(kernels[i]))
+        {
+            printf("%-10s unsupported\n", kernels[i]->name);
+            continue;
+        }
+
+        memset(pixels, 0, sizeof(pixels));
+        bench_decode(kernels[i]);
+        bench_apply(kernels[i], pixels);
+        if (memcmp(pixels, expected, sizeof(expected)))
+        {
+            printf("[!] %s kernels don't match per-bit decoding\n", kernels[i]->name);
+            return EXIT_FAILURE;
+        }
+
+        /* decoding only happens when vram is written, applying the palette happens for every pixel drawn */
+        double decode = bench_time(kernels[i], iterations, true);
+        double apply = bench_time(kernels[i], iterations, false);
+        printf("%-10s decode %8.1f, palette %8.1f Mpixel/s%s\n", kernels[i]->name, megapixels / decode, megapixels / apply,
+               kernels[i] == pixel_select() ? " (selected)" : "");
+    }
+
+    return EXIT_SUCCESS;
+}
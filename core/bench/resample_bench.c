@@ -0,0 +1,93 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "core/apu.h"
+#include "core/resample.h"
+
+/*
+ * resample_bench - times the resampling kernels the host supports, converting random input from the mixer's rate
+ *
+ * usage: core_resample_bench [iterations] [output rate]
+ */
+
+#define BENCH_INPUT (RESAMPLE_SIZE / 2)
+#define BENCH_OUTPUT (RESAMPLE_SIZE * 2)
+
+static resample_t resampler;
+static f32 input[2][BENCH_INPUT];
+static f32 expected[BENCH_OUTPUT * 2];
+static f32 output[BENCH_OUTPUT * 2];
+
+/* one block through the resampler, topping it up as the mixer would */
+static usize bench_run(resample_kernels_t *kernels, f32 *out)
+{
+    resampler.kernels = kernels;
+    resampler.position = 0;
+
+    for (usize channel = 0; channel < 2; channel++)
+        for (usize i = 0; i < BENCH_INPUT; i++)
+            resampler.input[channel][i] = input[channel][i];
+    resampler.length = BENCH_INPUT;
+
+    return resample_read(&resampler, NULL, out, BENCH_OUTPUT);
+}
+
+static double bench_time(resample_kernels_t *kernels, usize iterations, usize *written)
+{
+    clock_t start = clock();
+
+    for (usize i = 0; i < iterations; i++)
+        *written = bench_run(kernels, output);
+
+    return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+int main(int argc, char *argv[])
+{
+    usize iterations = argc > 1 ? (usize)atol(argv[1]) : 2000;
+    usize output_rate = argc > 2 ? (usize)atol(argv[2]) : 48000;
+
+    srand(1);
+    for (usize channel = 0; channel < 2; channel++)
+        for (usize i = 0; i < BENCH_INPUT; i++)
+            input[channel][i] = (f32)rand() / RAND_MAX - 0.5f;
+
+    resample_init(&resampler, APU_RATE, output_rate);
+    usize length = bench_run(&resample_kernels_scalar, expected);
+
+    resample_kernels_t *kernels[] = {
+        &resample_kernels_scalar,
+#ifdef RESAMPLE_SIMD
+        &resample_kernels_sse2,
+        &resample_kernels_avx2,
+#endif
+    };
+
+    for (usize i = 0; i < sizeof(kernels) / sizeof(kernels[0]); i++)
+    {
+        if (!resample_supported(kernels[i]))
+        {
+            printf("%-10s unsupported\n", kernels[i]->name);
+            continue;
+        }
+
+        /* the vector kernels add up in a different order, so only close is expected */
+        bench_run(kernels[i], output);
+        for (usize j = 0; j < length * 2; j++)
+        {
+            if (fabsf(output[j] - expected[j]) > 1e-5f)
+            {
+                printf("[!] %s kernel doesn't match the scalar one\n", kernels[i]->name);
+                return EXIT_FAILURE;
+            }
+        }
+
+        usize written = 0;
+        double seconds = bench_time(kernels[i], iterations, &written);
+        printf("%-10s %8.1f Msample/s%s\n", kernels[i]->name, (double)written * iterations / seconds / 1e6,
+               kernels[i] == resample_select() ? " (selected)" : "");
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -3,7 +3,9 @@
 #define APU_H
 
 #include <stdio.h>
+#include "blip.h"
 #include "bus.h"
+#include "resample.h"
 #include "util.h"
 
 #define MMAP_IO_NR10 0xFF10
@@ -38,6 +40,10 @@
 #define AMP_CHL (AMP_MAX / 0x04)
 #define AMP_BASE (AMP_CHL / 0x10)
 
+#define APU_CHANNELS 4
+#define APU_RATE (CPU_FREQUENCY / 64) /* the mixer's own sample rate, resampled to whatever's asked for on the way out */
+#define APU_FLUSH_CYCLES 0x1000 /* how often mixed samples are handed over */
+
 /*
  * timer - a simple timer struct which counts down from the period
  */
@@ -48,6 +54,8 @@ typedef struct timer
 } timer_t;
 
 bool timer_tick(timer_t *timer);
+usize timer_advance(timer_t *timer, usize cycles);
+usize timer_step(timer_t *timer, usize cycles);
 void timer_reset(timer_t *timer);
 
 /*
@@ -72,7 +80,8 @@ typedef struct duty
     bool enabled, state;
 } duty_t;
 
-void duty_cycle(duty_t *duty);
+void duty_cycle(duty_t *duty, usize cycles);
+usize duty_step(duty_t *duty, usize cycles);
 
 typedef struct envelope
 {
@@ -106,7 +115,9 @@ typedef struct wave
     u8 output;
 } wave_t;
 
-void wave_cycle(wave_t *wave, bus_t *bus);
+void wave_cycle(wave_t *wave, bus_t *bus, usize cycles);
+usize wave_step(wave_t *wave, bus_t *bus, usize cycles);
+void wave_fetch(wave_t *wave, bus_t *bus);
 
 typedef struct noise
 {
@@ -117,7 +128,9 @@ typedef struct noise
     bool state;
 } noise_t;
 
-void noise_cycle(noise_t *noise);
+void noise_cycle(noise_t *noise, usize cycles);
+usize noise_step(noise_t *noise, usize cycles);
+void noise_shift(noise_t *noise);
 
 typedef struct channel
 {
@@ -133,10 +146,49 @@ typedef struct channel
 
 void channel_length_cycle(channel_t *channel);
 
+/*
+ * block - caller owned buffer the mixer writes interleaved left & right samples straight into
+ */
+
+typedef enum apu_format
+{
+    APU_FORMAT_I16,
+    APU_FORMAT_F32
+} apu_format_t;
+
+typedef void (*apu_block_full_t)(void *user, const void *samples, usize length);
+
+typedef struct apu_block
+{
+    void *samples; /* i16 or f32 going by format, samples wait in the mixer while this is null */
+    apu_format_t format;
+    usize capacity; /* in sample pairs */
+    usize length;   /* sample pairs written since the block was last emptied */
+
+    /* called once the block fills, after which it starts over from the beginning, without one the block stays full */
+    apu_block_full_t full;
+    void *user;
+} apu_block_t;
+
 typedef struct apu
 {
     /* audio variables */
-    usize sample_rate, latency;
+    usize sample_rate, latency; /* of the output */
+
+    /* timing */
+    u64 clock; /* cycle the channels have been caught up to */
+
+    /* mixing, channels only report when their level changes */
+    blip_t left, right;
+    i16 levels[APU_CHANNELS][2]; /* last level each channel gave, left & right */
+    resample_t resampler;
+
+    /* output */
+    apu_block_t block;
+    u64 sample; /* sample pairs written to blocks since power on */
+    bool muted; /* channels keep time, but nothing is mixed or written */
+
+    /* everything from here on is cleared when the apu is switched off */
 
     /* registers */
     u8 nr10, nr11, nr12, nr13, nr14; /* channel 1 */
@@ -152,31 +204,38 @@ typedef struct apu
     channel_t ch3; /* wave output */
     channel_t ch4; /* noise */
 
-    /* timing */
-    u16 clock, tick;
-
     /* frame sequencer */
     u8 frame_sequence;
-
-    /* mixing */
-    usize sample;
-    i16 output_left, output_right;
-    bool update;
 } apu_t;
 
 void apu_init(apu_t *apu, usize sample_rate, usize latency);
+void apu_power_off(apu_t *apu);
 
-void apu_cycle(apu_t *apu, bus_t *bus, usize cycles);
+void apu_schedule(apu_t *apu, bus_t *bus);
+void apu_sync(apu_t *apu, bus_t *bus);
+void apu_sequencer_event(apu_t *apu, bus_t *bus);
+void apu_sample_event(apu_t *apu, bus_t *bus);
 void apu_frame_sequencer(apu_t *apu);
 
+bool apu_audible(apu_t *apu, channel_t *channel, u8 volume);
+void apu_channel_run(apu_t *apu, bus_t *bus, u8 index, u64 start, usize cycles);
+void apu_channel_mix(apu_t *apu, u8 index, u64 time);
+void apu_mix(apu_t *apu, u64 time);
+
+void apu_set_block(apu_t *apu, void *samples, apu_format_t format, usize capacity, apu_block_full_t full, void *user);
+usize apu_available(apu_t *apu);
+usize apu_fill(apu_t *apu);
+void apu_set_muted(apu_t *apu, bool muted);
+void apu_adjust_rate(apu_t *apu, f32 ratio);
+
 void apu_ch1_trigger(apu_t *apu);
 void apu_ch2_trigger(apu_t *apu);
 void apu_ch3_trigger(apu_t *apu);
 
-void apu_ch1_sample(apu_t *apu);
-void apu_ch2_sample(apu_t *apu);
-void apu_ch3_sample(apu_t *apu);
-void apu_ch4_sample(apu_t *apu);
+void apu_ch1_sample(apu_t *apu, i16 level[2]);
+void apu_ch2_sample(apu_t *apu, i16 level[2]);
+void apu_ch3_sample(apu_t *apu, i16 level[2]);
+void apu_ch4_sample(apu_t *apu, i16 level[2]);
 
 u8 apu_peek(apu_t *apu, u16 address);
 void apu_poke(apu_t *apu, u16 address, u8 value);
@@ -0,0 +1,38 @@
+#ifndef BLIP_H
+#define BLIP_H
+
+#include "util.h"
+
+#define BLIP_PHASES 32 /* sub-sample positions the step is tabulated at */
+#define BLIP_TAPS 16   /* samples each step is spread across */
+#define BLIP_SIZE 4096 /* samples that can wait to be read */
+#define BLIP_UNIT 15   /* fraction bits of the step table */
+#define BLIP_BASS 9    /* the dc blocker takes 1 / 2^BLIP_BASS of the level away each sample */
+
+/*
+ * blip - band limited synthesis, levels arrive as timestamped changes which are each spread across a few samples
+ * as a windowed sinc step, then integrated back up as they're read, so edges between samples no longer alias
+ */
+
+typedef struct blip
+{
+    u64 factor; /* samples per cycle, 32.32 fixed point */
+    u64 offset; /* where `clock` falls in the buffer, in the same units */
+    u64 clock;  /* cycle the buffer has been advanced up to */
+    usize end;  /* one past the last sample any change has reached */
+    i32 sum;    /* running total of the changes read so far */
+    i32 buffer[BLIP_SIZE + BLIP_TAPS];
+} blip_t;
+
+void blip_init(blip_t *blip, usize clock_rate, usize sample_rate);
+
+void blip_add(blip_t *blip, u64 time, i32 delta);
+void blip_advance(blip_t *blip, u64 time);
+void blip_skip(blip_t *blip, u64 time);
+
+usize blip_available(blip_t *blip);
+usize blip_read(blip_t *blip, i16 *samples, usize count, usize stride);
+usize blip_read_f32(blip_t *blip, f32 *samples, usize count, usize stride);
+usize blip_integrate(blip_t *blip, i16 *samples_i16, f32 *samples_f32, usize count, usize stride);
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef BLOCK_H
+#define BLOCK_H
+
+#include "bus.h"
+#include "opc.h"
+#include "util.h"
+
+#define BLOCK_CACHE_SIZE 0x1000 /* must be a power of two */
+#define BLOCK_MAX_OPS 16
+
+/*
+ * block_op - a pre-decoded instruction, with its immediate already read
+ */
+
+typedef struct block_op
+{
+    u8 opcode;
+    u16 imm16;
+} block_op_t;
+
+/*
+ * block - a straight run of rom instructions ending at a branch, keyed by pc & rom bank
+ */
+
+typedef struct block
+{
+    bool valid;
+    u16 pc, bank;
+    u8 length;
+    block_op_t ops[BLOCK_MAX_OPS];
+    void *code; /* native code, when compiled by the jit */
+    u8 hits;
+    bool idle; /* spins on reads alone, so only an event can make it leave */
+} block_t;
+
+typedef struct block_cache
+{
+    block_t *blocks;
+} block_cache_t;
+
+void block_cache_init(block_cache_t *cache);
+void block_cache_free(block_cache_t *cache);
+void block_cache_flush(block_cache_t *cache);
+
+block_t *block_lookup(block_cache_t *cache, bus_t *bus, u16 pc);
+void block_decode(block_t *block, bus_t *bus, u16 pc, u16 bank);
+bool block_ends(u8 opcode);
+bool block_spins(block_t *block, u16 end);
+bool block_op_registers(block_op_t *op, u8 *reads, u8 *writes);
+
+#endif
@@ -8,6 +8,7 @@ typedef struct cpu cpu_t;
 typedef struct apu apu_t;
 typedef struct mmu mmu_t;
 typedef struct ppu ppu_t;
+typedef struct sched sched_t;
 
 typedef struct bus
 {
@@ -15,9 +16,10 @@ typedef struct bus
     apu_t *apu;
     mmu_t *mmu;
     ppu_t *ppu;
+    sched_t *sched;
 } bus_t;
 
-void bus_init(bus_t *bus, cpu_t *cpu, apu_t *apu, mmu_t *mmu, ppu_t *ppu);
+void bus_init(bus_t *bus, cpu_t *cpu, apu_t *apu, mmu_t *mmu, ppu_t *ppu, sched_t *sched);
 
 u8 bus_peek8(bus_t *bus, u16 address);
 u16 bus_peek16(bus_t *bus, u16 address);
@@ -3,7 +3,9 @@
 #define CPU_H
 
 #include "opc.h"
+#include "block.h"
 #include "bus.h"
+#include "jit.h"
 #include "util.h"
 
 /* flags */
@@ -26,6 +28,25 @@
 #define APU_CLOCK 0x2000
 #define DIV_CLOCK 256
 
+typedef enum cpu_backend
+{
+	CPU_BACKEND_INTERPRETER,
+	CPU_BACKEND_JIT /* falls back to the interpreter where unsupported */
+} cpu_backend_t;
+
+#ifdef CPU_LAZY_FLAGS
+/*
+ * cpu_flags - what the last flag setting op produced, f is only built from this when it's read
+ */
+
+typedef struct cpu_flags
+{
+	u16 result; /* z is set when the low byte is zero, c is bit 8 */
+	u8 operands; /* operands xored together, h is bit 4 of this ^ result */
+	bool n;
+} cpu_flags_t;
+#endif
+
 typedef struct cpu
 {
 	struct
@@ -81,12 +102,15 @@ typedef struct cpu
 
 		u16 sp, pc;
 	} registers;
+#ifdef CPU_LAZY_FLAGS
+	cpu_flags_t flags; /* stands in for f, which is left stale */
+#endif
 	struct
 	{
-		u8 cycles;
-		u16 div_clock;
-		u16 tima_clock;
-		u16 fs_clock;
+		u32 cycles;
+		u64 div_tick; /* when div & tima last went up, they're caught up from these when read rather than ticked */
+		u64 tima_tick;
+		bool timer_read; /* the last block read div or tima, which change without an event */
 	} clock;
 	struct
 	{
@@ -100,11 +124,68 @@ typedef struct cpu
 
 	bool stopped;
 	bool halted;
+
+	cpu_backend_t backend;
+	block_cache_t cache;
+	jit_t jit;
 } cpu_t;
 
 extern usize tac_cycles[4];
 
-void cpu_init(cpu_t *cpu, bool is_cgb);
+/*
+ * flag access, always go through these as f is only up to date without CPU_LAZY_FLAGS
+ *
+ * cpu_flags_result takes an alu result with the carry in bit 8 & the operands xored together, cpu_flags takes each flag
+ */
+#ifdef CPU_LAZY_FLAGS
+static inline bool cpu_flag_z(cpu_t *cpu) { return !(cpu->flags.result & 0xFF); }
+static inline bool cpu_flag_n(cpu_t *cpu) { return cpu->flags.n; }
+static inline bool cpu_flag_h(cpu_t *cpu) { return ((cpu->flags.result ^ cpu->flags.operands) >> 4) & 1; }
+static inline bool cpu_flag_c(cpu_t *cpu) { return (cpu->flags.result >> 8) & 1; }
+
+static inline void cpu_flags_result(cpu_t *cpu, u16 result, u8 operands, bool n)
+{
+	cpu->flags.result = result;
+	cpu->flags.operands = operands;
+	cpu->flags.n = n;
+}
+
+static inline void cpu_flags(cpu_t *cpu, bool z, bool n, bool h, bool c)
+{
+	cpu->flags.result = (u16)(!z) | ((u16)c << 8);
+	cpu->flags.operands = (u8)cpu->flags.result ^ (h << 4);
+	cpu->flags.n = n;
+}
+#else
+static inline bool cpu_flag_z(cpu_t *cpu) { return cpu->registers.flag_z; }
+static inline bool cpu_flag_n(cpu_t *cpu) { return cpu->registers.flag_n; }
+static inline bool cpu_flag_h(cpu_t *cpu) { return cpu->registers.flag_h; }
+static inline bool cpu_flag_c(cpu_t *cpu) { return cpu->registers.flag_c; }
+
+static inline void cpu_flags_result(cpu_t *cpu, u16 result, u8 operands, bool n)
+{
+	cpu->registers.f = IS_ZERO(result & 0xFF) << 7 | n << 6 | ((result ^ operands) & 0x10) << 1 | ((result >> 4) & 0x10);
+}
+
+static inline void cpu_flags(cpu_t *cpu, bool z, bool n, bool h, bool c)
+{
+	cpu->registers.f = z << 7 | n << 6 | h << 5 | c << 4;
+}
+#endif
+
+/* f as a byte, for push af, pop af & the jit */
+static inline u8 cpu_flags_get(cpu_t *cpu)
+{
+	return cpu_flag_z(cpu) << 7 | cpu_flag_n(cpu) << 6 | cpu_flag_h(cpu) << 5 | cpu_flag_c(cpu) << 4;
+}
+
+static inline void cpu_flags_set(cpu_t *cpu, u8 f)
+{
+	cpu_flags(cpu, f & 0x80, f & 0x40, f & 0x20, f & 0x10);
+}
+
+void cpu_init(cpu_t *cpu, bool is_cgb, cpu_backend_t backend);
+void cpu_free(cpu_t *cpu);
 
 void cpu_fault(cpu_t *cpu, bus_t *bus, opc_t *opc, const char *message);
 void cpu_trace(cpu_t *cpu, opc_t *opc);
@@ -114,12 +195,23 @@ void cpu_dump(cpu_t *cpu);
 void cpu_call(cpu_t *cpu, bus_t *bus, u16 address);
 void cpu_ret(cpu_t *cpu, bus_t *bus);
 void cpu_execute(cpu_t *cpu, bus_t *bus, u8 opcode);
+void cpu_execute_op(cpu_t *cpu, bus_t *bus, u8 opcode, u16 imm16);
 void cpu_execute_cb(cpu_t *cpu, bus_t *bus, u8 opcode);
+void cpu_execute_block(cpu_t *cpu, bus_t *bus, block_t *block);
+bool cpu_retire(cpu_t *cpu, bus_t *bus, u16 bank);
+bool cpu_interrupted(cpu_t *cpu, bus_t *bus, u16 bank);
+void cpu_skip_idle(cpu_t *cpu, bus_t *bus);
+u32 cpu_sleep_cycles(cpu_t *cpu, bus_t *bus);
 void cpu_request(cpu_t *cpu, bus_t *bus, u8 index);
 void cpu_interrupt(cpu_t *cpu, bus_t *bus, u16 address);
 
 void cpu_cycle(cpu_t *cpu, bus_t *bus);
 void cpu_cycle_interrupt(cpu_t *cpu, bus_t *bus);
-void cpu_cycle_clock(cpu_t *cpu, bus_t *bus, usize cycles);
+
+usize cpu_clock_period(cpu_t *cpu, bus_t *bus, usize cycles);
+void cpu_sync_timers(cpu_t *cpu, bus_t *bus);
+void cpu_reset_timers(cpu_t *cpu, bus_t *bus, u16 address);
+void cpu_schedule_tima(cpu_t *cpu, bus_t *bus);
+void cpu_tima_event(cpu_t *cpu, bus_t *bus);
 
 #endif
@@ -1,4 +1,3 @@
-
 #ifndef DMG_H
 #define DMG_H
 
@@ -7,6 +6,7 @@
 #include "mmu.h"
 #include "ppu.h"
 #include "bus.h"
+#include "sched.h"
 
 typedef struct dmg
 {
@@ -15,11 +15,33 @@ typedef struct dmg
 	mmu_t mmu;
 	ppu_t ppu;
     bus_t bus;
+    sched_t sched;
 } dmg_t;
 
-void dmg_init(dmg_t* dmg, rom_t* rom, bool is_cgb, usize sample_rate, usize latency);
+/* upper bound on a single dmg_run_frame, well past any one frame's length so it only stops a run that never reaches v-blank */
+#define DMG_FRAME_CYCLES (CYCLES_FRAME * 2)
+
+/*
+ * dmg_output - caller owned buffers filled by the run functions, either buffer may be null
+ */
+
+typedef struct dmg_output
+{
+    u32 *video; /* LCD_WIDTH * LCD_HEIGHT pixels, copied whenever a frame is drawn */
+    void *audio; /* interleaved left & right samples, in place of the apu's own block for the length of the run */
+    apu_format_t audio_format;
+    usize audio_capacity; /* in sample pairs */
+
+    usize audio_length; /* sample pairs written by the last run */
+    bool drawn; /* whether the last run drew a frame into video */
+} dmg_output_t;
+
+void dmg_init(dmg_t* dmg, rom_t* rom, bool is_cgb, usize sample_rate, usize latency, cpu_backend_t backend, ppu_renderer_t renderer);
 void dmg_free(dmg_t* dmg);
 
 void dmg_cycle(dmg_t* dmg);
+usize dmg_run_cycles(dmg_t* dmg, usize cycles, dmg_output_t* output);
+usize dmg_run_frame(dmg_t* dmg, dmg_output_t* output);
+void dmg_event(dmg_t* dmg, sched_event_t event);
 
 #endif
@@ -2,6 +2,7 @@
 #ifndef DMG_HPP
 #define DMG_HPP
 
+#include <span>
 #include <string>
 #include "util.h"
 
@@ -33,6 +34,35 @@ namespace gmb
             : core(core)
             , sample_rate(core.apu.sample_rate)
             , latency(core.apu.latency) {}
+
+        /* hands the mixer a block to write into, `full` gets it back each time it fills */
+        void output(std::span<i16> samples, gmb_c::apu_block_full_t full = nullptr, void* user = nullptr) {
+            gmb_c::apu_set_block(&core.apu, samples.data(), gmb_c::APU_FORMAT_I16, samples.size() / 2, full, user);
+        }
+
+        void output(std::span<f32> samples, gmb_c::apu_block_full_t full = nullptr, void* user = nullptr) {
+            gmb_c::apu_set_block(&core.apu, samples.data(), gmb_c::APU_FORMAT_F32, samples.size() / 2, full, user);
+        }
+
+        /* what's been written into the block so far, interleaved left & right */
+        template <typename T>
+        std::span<const T> block() const {
+            return {static_cast<const T*>(core.apu.block.samples), core.apu.block.length * 2};
+        }
+
+        u64 samples() const {
+            return core.apu.sample;
+        }
+
+        /* while muted the channels keep time, but nothing is mixed, resampled or written */
+        void mute(bool muted) {
+            gmb_c::apu_set_muted(&core.apu, muted);
+        }
+
+        /* above 1 for a little more output than the sample rate, below 1 for a little less */
+        void adjust_rate(f32 ratio) {
+            gmb_c::apu_adjust_rate(&core.apu, ratio);
+        }
     };
 
     struct MMU {
@@ -80,7 +110,9 @@ namespace gmb
         MMU mmu;
         PPU ppu;
 
-        DMG(ROM& rom, bool is_cgb, usize sample_rate, usize latency)
+        DMG(ROM& rom, bool is_cgb, usize sample_rate, usize latency,
+            gmb_c::cpu_backend_t backend = gmb_c::CPU_BACKEND_INTERPRETER,
+            gmb_c::ppu_renderer_t renderer = gmb_c::PPU_RENDERER_SCANLINE)
             : apu(core)
             , mmu(core)
             , ppu(core) {
@@ -88,7 +120,9 @@ namespace gmb
                     &core,
                     &rom.core_rom, is_cgb,
                     sample_rate,
-                    latency);
+                    latency,
+                    backend,
+                    renderer);
         }
 
         ~DMG() {
@@ -98,6 +132,14 @@ namespace gmb
         void cycle() {
             gmb_c::dmg_cycle(&core);
         }
+
+        usize run_cycles(usize cycles, gmb_c::dmg_output_t& output) {
+            return gmb_c::dmg_run_cycles(&core, cycles, &output);
+        }
+
+        usize run_frame(gmb_c::dmg_output_t& output) {
+            return gmb_c::dmg_run_frame(&core, &output);
+        }
     };
 }
 
@@ -0,0 +1,75 @@
+#ifndef FIFO_H
+#define FIFO_H
+
+#include "bus.h"
+#include "util.h"
+
+#define FIFO_CYCLES_OAM_SCAN 80
+#define FIFO_CYCLES_TRANSFER 172 /* mode 3 with no scroll, window or sprites */
+#define FIFO_CYCLES_START 6 /* the first tile is fetched twice, the first one is thrown away */
+#define FIFO_CYCLES_SPRITE 6
+#define FIFO_CYCLES_MAX 375 /* what's left of the line after the oam scan, less a dot of h-blank */
+
+/*
+ * fifo - the pixel fifo ppu, draws a line a dot at a time so writes made during mode 3 land mid-line
+ */
+
+typedef struct fifo_pixel
+{
+    u8 color; /* colour id, 0 is transparent for sprites */
+    u8 attributes; /* cgb tile attributes, or the sprite's oam attributes */
+    u8 sprite; /* oam index of the sprite it came from, which decides overlaps on cgb */
+} fifo_pixel_t;
+
+typedef struct fifo_queue
+{
+    fifo_pixel_t pixels[8];
+    u8 head;
+    u8 count;
+} fifo_queue_t;
+
+typedef struct fifo
+{
+    usize dot; /* dots into mode 3 */
+    usize length; /* dots mode 3 was scheduled to last */
+    u8 x; /* next pixel to be drawn */
+    u8 discard; /* pixels still to drop, for fine scroll & windows left of the screen */
+    u8 delay;
+    bool window;
+    bool done;
+    bool ahead; /* drawn to the end by fifo_predict, as if nothing were written during mode 3 */
+    u8 window_line; /* lines of the window drawn this frame */
+    u16 fetched; /* oam scan slots already fetched this line */
+
+    fifo_queue_t background;
+    fifo_queue_t sprites;
+
+    struct
+    {
+        u8 step; /* dots into the current fetch, 2 each for the tile id, low & high bytes, then a push once empty */
+        u8 x; /* tile column, from the scroll or the window's left edge */
+        u8 tile_id;
+        u8 attributes;
+        u8 row[8]; /* colour ids, latched when the high bitplane is read */
+    } fetcher;
+
+    struct
+    {
+        bool active;
+        u8 slot; /* in the oam scan */
+        u8 step;
+    } sprite;
+} fifo_t;
+
+void fifo_start(ppu_t *ppu, bus_t *bus);
+usize fifo_predict(ppu_t *ppu, bus_t *bus);
+void fifo_rewind(ppu_t *ppu);
+void fifo_run(fifo_t *fifo, ppu_t *ppu, bus_t *bus, usize dot);
+void fifo_finish(ppu_t *ppu, bus_t *bus);
+
+void fifo_step(fifo_t *fifo, ppu_t *ppu, bus_t *bus);
+void fifo_fetch(fifo_t *fifo, ppu_t *ppu, bus_t *bus);
+void fifo_fetch_sprite(fifo_t *fifo, ppu_t *ppu, bus_t *bus);
+void fifo_shift(fifo_t *fifo, ppu_t *ppu, bus_t *bus);
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include "block.h"
+#include "bus.h"
+#include "util.h"
+
+/* native code is only emitted for x86-64, everywhere else the interpreter is used */
+#if defined(__x86_64__) || defined(_M_X64)
+#define JIT_SUPPORTED
+#endif
+
+#define JIT_CODE_SIZE 0x400000
+#define JIT_BLOCK_SIZE 0x2000 /* upper bound on the code emitted for a single block */
+#define JIT_THRESHOLD 8 /* runs through the interpreter before a block is worth compiling */
+
+/*
+ * jit - translates cached rom blocks into native code, ops it can't inline call back into the interpreter
+ */
+
+typedef void (*jit_code_t)(cpu_t *cpu, bus_t *bus);
+
+typedef struct jit
+{
+    u8 *code;
+    usize used;
+    u32 cycles; /* cycles run so far by the executing block */
+} jit_t;
+
+bool jit_init(jit_t *jit);
+void jit_free(jit_t *jit);
+void jit_flush(jit_t *jit, block_cache_t *cache);
+
+jit_code_t jit_compile(jit_t *jit, block_cache_t *cache, block_t *block);
+void jit_execute_block(cpu_t *cpu, bus_t *bus, block_t *block);
+
+#endif
@@ -2,6 +2,7 @@
 #ifndef MMU_H
 #define MMU_H
 
+#include "pixel.h"
 #include "rom.h"
 #include "util.h"
 
@@ -17,6 +18,12 @@
 #define CGB_WRAM_COUNT 0x8
 #define CGB_PALETTE_COUNT 0x40
 
+#define VRAM_TILE_COUNT 384
+#define VRAM_TILE_SIZE 64
+
+#define MMU_PAGE_COUNT 0x100
+#define MMU_PAGE_SIZE 0x100
+
 #define MMAP_ROM_00 0x0000
 #define MMAP_ROM_01 0x4000
 #define MMAP_VRAM 0x8000
@@ -73,6 +80,22 @@ typedef struct mmu
         u8 *hram;
         u8 interrupt_enable;
     } memory;
+
+    /* vram tiles decoded to a byte per pixel, both unflipped & flipped on x, redecoded when read after a write */
+    struct
+    {
+        u8 *decoded[CGB_VRAM_COUNT];
+        u32 dirty[CGB_VRAM_COUNT][VRAM_TILE_COUNT / 32];
+        pixel_kernels_t *kernels;
+    } tiles;
+
+    /* page tables, indexed by the high byte of an address (null pages take the slow path) */
+    struct
+    {
+        u8 *read[MMU_PAGE_COUNT];
+        u8 *write[MMU_PAGE_COUNT];
+    } map;
+    u16 rom_bank;
     struct
     {
         u8 joyp;
@@ -131,13 +154,17 @@ typedef struct mmu
     {
         u8 background[CGB_PALETTE_COUNT];
         u8 foreground[CGB_PALETTE_COUNT];
+
+        /* the palettes above & bgp, obp0, obp1 as rgba by palette & colour id, updated as they're written */
+        u32 background_colors[CGB_PALETTE_COUNT / 8][4];
+        u32 foreground_colors[CGB_PALETTE_COUNT / 8][4];
+        u32 dmg_colors[3][4];
     } palette;
     struct
     {
         u8 start, select;
         u8 a, b;
         u8 down, up, left, right;
-        u8 turbo;
     } buttons;
     struct
     {
@@ -154,11 +181,25 @@ typedef struct mmu
 void mmu_init(mmu_t *mmu, rom_t *rom);
 void mmu_free(mmu_t *mmu);
 
+void mmu_map_pages(mmu_t *mmu, u16 address, usize size, u8 *memory, bool writable);
+void mmu_map_rom(mmu_t *mmu, u16 bank);
+void mmu_map_vram(mmu_t *mmu);
+void mmu_map_wram(mmu_t *mmu);
+
 u8 *mmu_map(mmu_t *mmu, u16 address);
+u8 *mmu_map_io(mmu_t *mmu, u16 address);
 
 u8 mmu_peek(mmu_t *mmu, u16 address);
 void mmu_poke(mmu_t *mmu, u16 address, u8 value);
 
 void mmu_hdma_copy_block(mmu_t *mmu);
 
+void mmu_update_cgb_color(u8 *palette, u32 colors[][4], u8 index);
+void mmu_update_dmg_colors(u32 colors[4], u8 palette);
+void mmu_update_colors(mmu_t *mmu);
+
+void mmu_poke_vram(mmu_t *mmu, u16 address, u8 value);
+void mmu_decode_tile(mmu_t *mmu, u8 bank, u16 index);
+u8 *mmu_tile(mmu_t *mmu, u8 bank, u16 index, bool flip_x);
+
 #endif
@@ -0,0 +1,35 @@
+#ifndef PIXEL_H
+#define PIXEL_H
+
+#include "util.h"
+
+/* vector kernels need gcc or clang on x86, everywhere else the scalar ones are used */
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define PIXEL_SIMD
+#endif
+
+/*
+ * pixel - kernels turning 2bpp tile data into colour ids & colour ids into rgba, picked at runtime for the host
+ */
+
+typedef struct pixel_kernels
+{
+    const char *name;
+
+    /* 16 bytes of bitplanes to 64 colour ids, row by row, both as is & flipped on x */
+    void (*decode_tile)(const u8 *data, u8 *tile, u8 *flipped);
+
+    /* colour ids to pixels through a palette of 4 colours */
+    void (*apply_palette)(const u8 *ids, const u32 *palette, u32 *pixels, usize count);
+} pixel_kernels_t;
+
+extern pixel_kernels_t pixel_kernels_scalar;
+#ifdef PIXEL_SIMD
+extern pixel_kernels_t pixel_kernels_sse2;
+extern pixel_kernels_t pixel_kernels_avx2;
+#endif
+
+bool pixel_supported(pixel_kernels_t *kernels);
+pixel_kernels_t *pixel_select(void);
+
+#endif
@@ -3,22 +3,26 @@
 #define PPU_H
 
 #include "bus.h"
+#include "fifo.h"
+#include "pixel.h"
 #include "util.h"
 
-#define CYCLES_ELAPSED(ppu, num_cycles) (ppu->cycles >= num_cycles)
-
-#define CYCLES_H_BLANK 207
-#define CYCLES_OAM_ACCESS 83
-#define CYCLES_LCD_TRANSFER 175
+#define CYCLES_H_BLANK 204
+#define CYCLES_OAM_ACCESS 80
+#define CYCLES_LCD_TRANSFER 172
 #define CYCLES_LINE 456
+#define CYCLES_RASTER_DELAY 12 /* into mode 3 before the first pixel is out, less fine scroll */
 
 #define SCANLINE_V_BLANK 144
 #define SCANLINE_MAX 153
 
+#define CYCLES_FRAME (CYCLES_LINE * (SCANLINE_MAX + 1))
+
 #define LCD_WIDTH 160
 #define LCD_HEIGHT 144
 
 #define MAX_SPRITES 10
+#define MAX_RASTER_WRITES 64
 
 typedef enum ppu_mode
 {
@@ -28,17 +32,40 @@ typedef enum ppu_mode
     MODE_LCD_TRANSFER
 } ppu_mode_t;
 
-typedef struct bg
+typedef enum ppu_renderer
+{
+    PPU_RENDERER_SCANLINE, /* draws each line whole at the end of mode 3, which always takes as long */
+    PPU_RENDERER_FIFO /* draws a dot at a time, mode 3 takes as long as the line needs */
+} ppu_renderer_t;
+
+typedef struct ppu_line
 {
-    u8 tile;
-    u32 color;
+    u32 (*palette)[4]; /* background colours, by palette & colour id */
+    u8 tiles[LCD_WIDTH]; /* background colour ids, for sprite priority */
+    u8 attributes[LCD_WIDTH];
+    bool taken[LCD_WIDTH]; /* by an opaque sprite */
+} ppu_line_t;
+
+typedef struct ppu_sprite
+{
+    i16 x;
+    u8 tile_id;
+    u8 tile_y; /* row of the sprite on this line, y flip applied */
     u8 attributes;
-} bg_t;
+    u8 index; /* in oam */
+} ppu_sprite_t;
+
+typedef struct ppu_write
+{
+    u8 x; /* first pixel drawn with the new value */
+    u8 address; /* low byte of the register */
+    u8 previous;
+    u8 value;
+} ppu_write_t;
 
 typedef struct ppu
 {
     ppu_mode_t mode;
-    u32 cycles;
     u8 line;
     bool enabled;
     struct
@@ -46,22 +73,41 @@ typedef struct ppu
         bool v_blank;
         bool lcd_stat;
     } interrupt;
+    struct
+    {
+        ppu_sprite_t sprites[MAX_SPRITES]; /* selected in the oam scan, highest priority first */
+        usize count;
+    } oam;
+    struct
+    {
+        ppu_write_t writes[MAX_RASTER_WRITES]; /* to registers during mode 3, replayed as the line is drawn */
+        usize count;
+        usize drawn; /* pixels of the line already drawn, when the log filled up before mode 3 ended */
+        ppu_line_t line;
+    } raster;
     u32 lcd[LCD_WIDTH * LCD_HEIGHT];
     bool is_cgb;
     usize frame;
     usize frame_step;
     bool draw;
+    pixel_kernels_t *kernels;
+    ppu_renderer_t renderer;
+    fifo_t fifo;
+    fifo_t fifo_start; /* as mode 3 began, see fifo_rewind */
 } ppu_t;
 
 extern u8 ppu_palette[12];
 
-void ppu_init(ppu_t *ppu, bool is_cgb);
+void ppu_init(ppu_t *ppu, bool is_cgb, ppu_renderer_t renderer);
 
-void ppu_enable(ppu_t *ppu);
-void ppu_disable(ppu_t *ppu);
+void ppu_enable(ppu_t *ppu, bus_t *bus);
+void ppu_disable(ppu_t *ppu, bus_t *bus);
 
 void ppu_update_ly(ppu_t *ppu, bus_t *bus);
-void ppu_cycle(ppu_t *ppu, bus_t *bus, usize cycles);
+usize ppu_oam_cycles(ppu_t *ppu);
+usize ppu_cycle(ppu_t *ppu, bus_t *bus);
+void ppu_sync(ppu_t *ppu, bus_t *bus, u16 address);
+void ppu_log_write(ppu_t *ppu, bus_t *bus, u16 address, u8 value);
 
 void ppu_set_pixel(ppu_t *ppu, usize x, usize y, u32 value);
 u32 ppu_get_pixel(ppu_t *ppu, usize x, usize y);
@@ -69,9 +115,13 @@ u32 ppu_get_pixel(ppu_t *ppu, usize x, usize y);
 u8 ppu_get_tile(ppu_t *ppu, bus_t *bus, u8 tile_id, usize tile_x, usize tile_y, bool is_sprite, u8 vram_bank);
 u8 ppu_convert_dmg_palette(u8 palette, u8 color_id);
 u16 ppu_convert_cgb_palette(bus_t *bus, u8 *palette, u8 palette_id, u8 color_id);
-
-bg_t ppu_render_background(ppu_t *ppu, bus_t *bus, u8 x, u8 y, u8 is_window);
-void ppu_render_sprites(ppu_t *ppu, bus_t *bus, usize x, usize y, u8 bg_tile);
-void ppu_render_line(ppu_t *ppu, bus_t *bus);
+u32 ppu_apply_dmg_palette(u8 *palette, u16 palette_id);
+u32 ppu_apply_cgb_palette(u16 raw_color);
+
+void ppu_render_tiles(ppu_t *ppu, bus_t *bus, ppu_line_t *line, usize start, usize end, u8 x, u8 y, u8 is_window);
+void ppu_scan_oam(ppu_t *ppu, bus_t *bus);
+void ppu_render_sprites(ppu_t *ppu, bus_t *bus, ppu_line_t *line, usize start, usize end);
+void ppu_render_span(ppu_t *ppu, bus_t *bus, ppu_line_t *line, usize start, usize end);
+void ppu_render_line(ppu_t *ppu, bus_t *bus, usize end);
 
 #endif
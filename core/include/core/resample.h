@@ -0,0 +1,56 @@
+#ifndef RESAMPLE_H
+#define RESAMPLE_H
+
+#include "util.h"
+
+/* vector kernels need gcc or clang on x86, everywhere else the scalar one is used */
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define RESAMPLE_SIMD
+#endif
+
+#define RESAMPLE_TAPS 32    /* input samples under the filter, a multiple of 8 for the vector kernels */
+#define RESAMPLE_PHASES 256 /* positions between two input samples the filter is tabulated at */
+#define RESAMPLE_SIZE 2048  /* input samples that can wait to be resampled */
+#define RESAMPLE_CUTOFF 0.9 /* passband, as a fraction of the lower of the two nyquist frequencies */
+
+/*
+ * resample - polyphase windowed sinc filter from one sample rate to another, the ratio between them can be nudged
+ * while running so the output keeps pace with whatever is consuming it
+ */
+
+typedef struct resample_kernels
+{
+    const char *name;
+
+    /* one output pair, the same taps run along the left & right input */
+    void (*filter)(const f32 *taps, const f32 *left, const f32 *right, f32 *output);
+} resample_kernels_t;
+
+extern resample_kernels_t resample_kernels_scalar;
+#ifdef RESAMPLE_SIMD
+extern resample_kernels_t resample_kernels_sse2;
+extern resample_kernels_t resample_kernels_avx2;
+#endif
+
+bool resample_supported(resample_kernels_t *kernels);
+resample_kernels_t *resample_select(void);
+
+typedef struct resample
+{
+    resample_kernels_t *kernels;
+
+    u64 base_step; /* input samples per output sample, 32.32 fixed point */
+    u64 step;      /* the same, after rate control */
+    u64 position;  /* where the next output sample falls in the input, in the same units */
+
+    usize length;                  /* input samples waiting */
+    f32 input[2][RESAMPLE_SIZE];   /* left & right kept apart, so the filter can run along each */
+    f32 taps[RESAMPLE_PHASES][RESAMPLE_TAPS];
+} resample_t;
+
+void resample_init(resample_t *resample, usize input_rate, usize output_rate);
+void resample_adjust(resample_t *resample, f32 ratio);
+
+usize resample_read(resample_t *resample, i16 *samples_i16, f32 *samples_f32, usize count);
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef SCHED_H
+#define SCHED_H
+
+#include "util.h"
+
+#define SCHED_NEVER U64_MAX
+
+typedef enum sched_event
+{
+    EVENT_PPU,
+    EVENT_TIMA, /* only tima overflowing, div & tima themselves are worked out when read */
+    EVENT_FRAME_SEQUENCER,
+    EVENT_APU_SAMPLE,
+    EVENT_COUNT,
+    EVENT_NONE = EVENT_COUNT
+} sched_event_t;
+
+/*
+ * sched - one deadline per event, measured in m-cycles since power on
+ */
+
+typedef struct sched
+{
+    u64 now;
+    u64 next; /* earliest deadline, so the hot loop only has to compare against one value */
+    u64 deadline[EVENT_COUNT];
+} sched_t;
+
+void sched_init(sched_t *sched);
+void sched_update(sched_t *sched);
+
+void sched_schedule(sched_t *sched, sched_event_t event, u64 cycles);
+void sched_repeat(sched_t *sched, sched_event_t event, u64 cycles);
+void sched_cancel(sched_t *sched, sched_event_t event);
+bool sched_scheduled(sched_t *sched, sched_event_t event);
+
+sched_event_t sched_pop(sched_t *sched);
+
+#endif
@@ -2,7 +2,11 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include "core/cpu.h"
 #include "core/mmu.h"
+#include "core/sched.h"
 
 u8 duty_table[4][8] = {
     {0, 0, 0, 0, 0, 0, 0, 1},
@@ -21,20 +25,65 @@ bool timer_tick(timer_t *timer)
     return false;
 }
 
+usize timer_advance(timer_t *timer, usize cycles)
+{
+    /* the same as ticking `cycles` times, but counts the reloads rather than stepping through them */
+    usize first = timer->counter ? timer->counter : 1;
+    if (cycles < first)
+    {
+        timer->counter -= cycles;
+        return 0;
+    }
+
+    cycles -= first;
+    usize period = timer->period ? timer->period : 1;
+    timer->counter = timer->period - cycles % period;
+    return 1 + cycles / period;
+}
+
+usize timer_step(timer_t *timer, usize cycles)
+{
+    /* moves to the next reload if it comes within `cycles`, returning how far that was (or 0 if it doesn't) */
+    usize until = timer->counter ? timer->counter : 1;
+    if (until > cycles)
+    {
+        timer->counter -= cycles;
+        return 0;
+    }
+
+    timer_reset(timer);
+    return until;
+}
+
 void timer_reset(timer_t *timer)
 {
     timer->counter = timer->period;
 }
 
-void duty_cycle(duty_t *duty)
+void duty_cycle(duty_t *duty, usize cycles)
 {
     duty->timer.period = (2048 - duty->frequency) * 4;
 
-    if (timer_tick(&duty->timer))
+    usize steps = timer_advance(&duty->timer, cycles);
+    if (steps)
+    {
+        duty->position += steps;
+        duty->state = duty_table[duty->pattern][duty->position % 0x8];
+    }
+}
+
+usize duty_step(duty_t *duty, usize cycles)
+{
+    duty->timer.period = (2048 - duty->frequency) * 4;
+
+    usize step = timer_step(&duty->timer, cycles);
+    if (step)
     {
         duty->position++;
         duty->state = duty_table[duty->pattern][duty->position % 0x8];
     }
+
+    return step;
 }
 
 void envelope_cycle(envelope_t *envelope)
@@ -87,39 +136,79 @@ u16 sweep_frequency_calc(sweep_t *sweep)
     return sweep->frequency + (sweep->frequency >> sweep->shift);
 }
 
-void wave_cycle(wave_t *wave, bus_t *bus)
+void wave_cycle(wave_t *wave, bus_t *bus, usize cycles)
 {
-    if (timer_tick(&wave->timer))
+    usize steps = timer_advance(&wave->timer, cycles);
+    if (steps)
+    {
+        /* only the last sample stepped over is ever heard */
+        wave->position += steps;
+        wave_fetch(wave, bus);
+    }
+}
+
+usize wave_step(wave_t *wave, bus_t *bus, usize cycles)
+{
+    usize step = timer_step(&wave->timer, cycles);
+    if (step)
     {
         wave->position++;
-        wave->output = bus_peek8(bus, MMAP_IO_WAVE + ((wave->position & 0x1F) / 2));
-        if (wave->position % 2)
-        {
-            wave->output &= 0xF;
-        }
-        else
-        {
-            wave->output >>= 4;
-        }
+        wave_fetch(wave, bus);
     }
+
+    return step;
 }
 
-void noise_cycle(noise_t *noise)
+void wave_fetch(wave_t *wave, bus_t *bus)
 {
-    if (timer_tick(&noise->timer))
+    wave->output = bus_peek8(bus, MMAP_IO_WAVE + ((wave->position & 0x1F) / 2));
+    if (wave->position % 2)
     {
-        u8 lfsr_low = noise->lfsr & 0xFF;
-        u8 tmp = (lfsr_low & 0x1) ^ ((lfsr_low & 0x2) >> 1);
-        noise->lfsr >>= 0x1;
-        noise->lfsr &= 0xBFFF;
-        noise->lfsr |= tmp * 0x4000;
-        if (noise->width_mode)
-        {
-            noise->lfsr &= 0xFFBF;
-            noise->lfsr |= tmp * 0x40;
-        }
+        wave->output &= 0xF;
+    }
+    else
+    {
+        wave->output >>= 4;
+    }
+}
+
+void noise_cycle(noise_t *noise, usize cycles)
+{
+    usize steps = timer_advance(&noise->timer, cycles);
+    if (!steps)
+        return;
+
+    /* the lfsr has no shortcut, but it shifts at most once every 8 cycles */
+    for (; steps; steps--)
+        noise_shift(noise);
+
+    noise->state = !(noise->lfsr & 0x1);
+}
+
+usize noise_step(noise_t *noise, usize cycles)
+{
+    usize step = timer_step(&noise->timer, cycles);
+    if (step)
+    {
+        noise_shift(noise);
         noise->state = !(noise->lfsr & 0x1);
     }
+
+    return step;
+}
+
+void noise_shift(noise_t *noise)
+{
+    u8 lfsr_low = noise->lfsr & 0xFF;
+    u8 tmp = (lfsr_low & 0x1) ^ ((lfsr_low & 0x2) >> 1);
+    noise->lfsr >>= 0x1;
+    noise->lfsr &= 0xBFFF;
+    noise->lfsr |= tmp * 0x4000;
+    if (noise->width_mode)
+    {
+        noise->lfsr &= 0xFFBF;
+        noise->lfsr |= tmp * 0x40;
+    }
 }
 
 void channel_length_cycle(channel_t *channel)
@@ -130,54 +219,116 @@ void channel_length_cycle(channel_t *channel)
 
 void apu_init(apu_t *apu, usize sample_rate, usize latency)
 {
-    *apu = (apu_t){0};
+    memset(apu, 0, sizeof(apu_t));
     apu->sample_rate = sample_rate;
     apu->latency = latency;
+
+    blip_init(&apu->left, CPU_FREQUENCY, APU_RATE);
+    blip_init(&apu->right, CPU_FREQUENCY, APU_RATE);
+    resample_init(&apu->resampler, APU_RATE, sample_rate);
 }
 
-void apu_cycle(apu_t *apu, bus_t *bus, usize cycles)
+void apu_power_off(apu_t *apu)
 {
-    usize m_cycles = cycles / 4;
+    /* registers & channels go, but not the clock or samples that are still to be read */
+    memset(&apu->nr10, 0, sizeof(apu_t) - offsetof(apu_t, nr10));
+}
 
-    apu->tick++;
+void apu_schedule(apu_t *apu, bus_t *bus)
+{
+    if (!apu->enabled)
+    {
+        sched_cancel(bus->sched, EVENT_FRAME_SEQUENCER);
+        sched_cancel(bus->sched, EVENT_APU_SAMPLE);
+        return;
+    }
 
-    apu->update = false;
-    if (apu->enabled)
+    if (!sched_scheduled(bus->sched, EVENT_FRAME_SEQUENCER))
+        sched_schedule(bus->sched, EVENT_FRAME_SEQUENCER, APU_CLOCK);
+    if (!sched_scheduled(bus->sched, EVENT_APU_SAMPLE))
     {
-        apu->clock += m_cycles;
+        /* no samples were made while switched off, so pick up from now */
+        blip_skip(&apu->left, bus->sched->now);
+        blip_skip(&apu->right, bus->sched->now);
+        sched_schedule(bus->sched, EVENT_APU_SAMPLE, APU_FLUSH_CYCLES);
+    }
+}
 
-        if (apu->tick % SPEED_SHIFT == 0 || !bus->mmu->buttons.turbo)
-        {
-            for (usize i = 0; i < m_cycles; i++)
-            {
-                if (apu->ch1.duty.enabled)
-                    duty_cycle(&apu->ch1.duty);
-                if (apu->ch2.duty.enabled)
-                    duty_cycle(&apu->ch2.duty);
-                wave_cycle(&apu->ch3.wave, bus);
-                noise_cycle(&apu->ch4.noise);
-            }
-        }
+void apu_sync(apu_t *apu, bus_t *bus)
+{
+    u64 start = apu->clock;
+    usize cycles = bus->sched->now - apu->clock;
+    apu->clock = bus->sched->now;
 
-        /* output sample to buffer */
-        usize cycles_per_sample = CPU_FREQUENCY / apu->sample_rate;
-        if (apu->clock >= cycles_per_sample)
-        {
-            apu->output_left = 0;
-            apu->output_right = 0;
+    if (!apu->enabled)
+        return;
 
-            apu_ch1_sample(apu);
-            apu_ch2_sample(apu);
-            apu_ch3_sample(apu);
-            apu_ch4_sample(apu);
+    /* nothing in between changes a channel, so a silent one catches up in one go & the rest report each step */
+    if (apu->ch1.duty.enabled)
+    {
+        if (apu_audible(apu, &apu->ch1, apu->ch1.envelope.volume))
+            apu_channel_run(apu, bus, 0, start, cycles);
+        else
+            duty_cycle(&apu->ch1.duty, cycles);
+    }
+    if (apu->ch2.duty.enabled)
+    {
+        if (apu_audible(apu, &apu->ch2, apu->ch2.envelope.volume))
+            apu_channel_run(apu, bus, 1, start, cycles);
+        else
+            duty_cycle(&apu->ch2.duty, cycles);
+    }
 
-            apu->sample++;
+    if (apu_audible(apu, &apu->ch3, apu->ch3.wave.shift))
+        apu_channel_run(apu, bus, 2, start, cycles);
+    else
+        wave_cycle(&apu->ch3.wave, bus, cycles);
 
-            apu->update = true;
+    if (apu_audible(apu, &apu->ch4, apu->ch4.envelope.volume))
+        apu_channel_run(apu, bus, 3, start, cycles);
+    else
+        noise_cycle(&apu->ch4.noise, cycles);
+}
 
-            apu->clock -= cycles_per_sample;
-        }
+void apu_sequencer_event(apu_t *apu, bus_t *bus)
+{
+    if (!apu->enabled)
+    {
+        sched_cancel(bus->sched, EVENT_FRAME_SEQUENCER);
+        return;
+    }
+
+    /* sweep may change the channel 1 frequency */
+    apu_sync(apu, bus);
+    apu_frame_sequencer(apu);
+    apu_mix(apu, apu->clock);
+
+    sched_repeat(bus->sched, EVENT_FRAME_SEQUENCER, APU_CLOCK);
+}
+
+void apu_sample_event(apu_t *apu, bus_t *bus)
+{
+    if (!apu->enabled)
+    {
+        sched_cancel(bus->sched, EVENT_APU_SAMPLE);
+        return;
     }
+
+    /* every sample up to now is complete once the channels have caught up */
+    apu_sync(apu, bus);
+    if (apu->muted)
+    {
+        blip_skip(&apu->left, apu->clock);
+        blip_skip(&apu->right, apu->clock);
+    }
+    else
+    {
+        blip_advance(&apu->left, apu->clock);
+        blip_advance(&apu->right, apu->clock);
+        apu_fill(apu);
+    }
+
+    sched_repeat(bus->sched, EVENT_APU_SAMPLE, APU_FLUSH_CYCLES);
 }
 
 void apu_frame_sequencer(apu_t *apu)
@@ -213,6 +364,143 @@ void apu_frame_sequencer(apu_t *apu)
     apu->frame_sequence = (apu->frame_sequence + 1) % 8;
 }
 
+bool apu_audible(apu_t *apu, channel_t *channel, u8 volume)
+{
+    return !apu->muted && channel->enabled && volume && ((channel->left && apu->left_volume) || (channel->right && apu->right_volume));
+}
+
+void apu_channel_run(apu_t *apu, bus_t *bus, u8 index, u64 start, usize cycles)
+{
+    /* one reload at a time, so each change in level reaches the mixer on the cycle it happened */
+    for (usize elapsed = 0; elapsed < cycles;)
+    {
+        usize step;
+        switch (index)
+        {
+        case 0:
+            step = duty_step(&apu->ch1.duty, cycles - elapsed);
+            break;
+        case 1:
+            step = duty_step(&apu->ch2.duty, cycles - elapsed);
+            break;
+        case 2:
+            step = wave_step(&apu->ch3.wave, bus, cycles - elapsed);
+            break;
+        default:
+            step = noise_step(&apu->ch4.noise, cycles - elapsed);
+            break;
+        }
+
+        if (!step)
+            break;
+
+        elapsed += step;
+        apu_channel_mix(apu, index, start + elapsed);
+    }
+}
+
+void apu_channel_mix(apu_t *apu, u8 index, u64 time)
+{
+    if (apu->muted)
+        return;
+
+    i16 level[2] = {0, 0};
+    switch (index)
+    {
+    case 0:
+        apu_ch1_sample(apu, level);
+        break;
+    case 1:
+        apu_ch2_sample(apu, level);
+        break;
+    case 2:
+        apu_ch3_sample(apu, level);
+        break;
+    default:
+        apu_ch4_sample(apu, level);
+        break;
+    }
+
+    blip_add(&apu->left, time, level[0] - apu->levels[index][0]);
+    blip_add(&apu->right, time, level[1] - apu->levels[index][1]);
+    apu->levels[index][0] = level[0];
+    apu->levels[index][1] = level[1];
+}
+
+void apu_mix(apu_t *apu, u64 time)
+{
+    /* after anything that could change a level other than the channel timers */
+    for (u8 i = 0; i < APU_CHANNELS; i++)
+        apu_channel_mix(apu, i, time);
+}
+
+void apu_set_block(apu_t *apu, void *samples, apu_format_t format, usize capacity, apu_block_full_t full, void *user)
+{
+    apu->block = (apu_block_t){samples, format, capacity, 0, full, user};
+}
+
+usize apu_available(apu_t *apu)
+{
+    return blip_available(&apu->left);
+}
+
+usize apu_fill(apu_t *apu)
+{
+    apu_block_t *block = &apu->block;
+    resample_t *resampler = &apu->resampler;
+    usize written = 0;
+
+    while (block->samples && block->length < block->capacity)
+    {
+        /* top the resampler up from the mixer, both sides always have the same number ready */
+        usize space = RESAMPLE_SIZE - resampler->length;
+        blip_read_f32(&apu->left, resampler->input[0] + resampler->length, space, 1);
+        resampler->length += blip_read_f32(&apu->right, resampler->input[1] + resampler->length, space, 1);
+
+        usize count = block->capacity - block->length;
+        if (block->format == APU_FORMAT_F32)
+            count = resample_read(resampler, NULL, (f32 *)block->samples + block->length * 2, count);
+        else
+            count = resample_read(resampler, (i16 *)block->samples + block->length * 2, NULL, count);
+
+        if (!count)
+            break;
+
+        block->length += count;
+        apu->sample += count;
+        written += count;
+
+        if (block->length == block->capacity && block->full)
+        {
+            block->full(block->user, block->samples, block->length);
+            block->length = 0;
+        }
+    }
+
+    return written;
+}
+
+void apu_set_muted(apu_t *apu, bool muted)
+{
+    if (apu->muted == muted)
+        return;
+
+    apu->muted = muted;
+
+    /* coming back, the mixer carries on from where the channels have got to & catches up with their levels */
+    if (!muted)
+    {
+        blip_skip(&apu->left, apu->clock);
+        blip_skip(&apu->right, apu->clock);
+        apu_mix(apu, apu->clock);
+    }
+}
+
+void apu_adjust_rate(apu_t *apu, f32 ratio)
+{
+    resample_adjust(&apu->resampler, ratio);
+}
+
 void apu_ch1_trigger(apu_t *apu)
 {
     apu->ch1.enabled = true;
@@ -288,47 +576,41 @@ void apu_ch4_trigger(apu_t *apu)
         apu->ch4.enabled = false;
 }
 
-void apu_ch1_sample(apu_t *apu)
+void apu_ch1_sample(apu_t *apu, i16 level[2])
 {
     if (apu->ch1.enabled)
     {
-        apu->output_left -= AMP_CHL / 2;
-        apu->output_right -= AMP_CHL / 2;
-        apu->output_left += AMP_BASE * apu->ch1.duty.state * apu->ch1.envelope.volume * apu->ch1.left * apu->left_volume;
-        apu->output_right += AMP_BASE * apu->ch1.duty.state * apu->ch1.envelope.volume * apu->ch1.right * apu->right_volume;
+        level[0] = -AMP_CHL / 2 + AMP_BASE * apu->ch1.duty.state * apu->ch1.envelope.volume * apu->ch1.left * apu->left_volume;
+        level[1] = -AMP_CHL / 2 + AMP_BASE * apu->ch1.duty.state * apu->ch1.envelope.volume * apu->ch1.right * apu->right_volume;
     }
 }
 
-void apu_ch2_sample(apu_t *apu)
+void apu_ch2_sample(apu_t *apu, i16 level[2])
 {
     if (apu->ch2.enabled)
     {
-        apu->output_left -= AMP_CHL / 2;
-        apu->output_right -= AMP_CHL / 2;
-        apu->output_left += AMP_BASE * apu->ch2.duty.state * apu->ch2.envelope.volume * apu->ch2.left * apu->left_volume;
-        apu->output_right += AMP_BASE * apu->ch2.duty.state * apu->ch2.envelope.volume * apu->ch2.right * apu->right_volume;
+        level[0] = -AMP_CHL / 2 + AMP_BASE * apu->ch2.duty.state * apu->ch2.envelope.volume * apu->ch2.left * apu->left_volume;
+        level[1] = -AMP_CHL / 2 + AMP_BASE * apu->ch2.duty.state * apu->ch2.envelope.volume * apu->ch2.right * apu->right_volume;
     }
 }
 
-void apu_ch3_sample(apu_t *apu)
+void apu_ch3_sample(apu_t *apu, i16 level[2])
 {
     if (apu->ch3.enabled)
     {
-        apu->output_left -= AMP_CHL / 2;
-        apu->output_right -= AMP_CHL / 2;
-        apu->output_left += AMP_BASE * (apu->ch3.wave.output >> (apu->ch3.wave.shift - 1)) * apu->ch3.left * apu->left_volume;
-        apu->output_right += AMP_BASE * (apu->ch3.wave.output >> (apu->ch3.wave.shift - 1)) * apu->ch3.right * apu->right_volume;
+        /* a shift of 0 mutes the channel */
+        u8 output = apu->ch3.wave.shift ? apu->ch3.wave.output >> (apu->ch3.wave.shift - 1) : 0;
+        level[0] = -AMP_CHL / 2 + AMP_BASE * output * apu->ch3.left * apu->left_volume;
+        level[1] = -AMP_CHL / 2 + AMP_BASE * output * apu->ch3.right * apu->right_volume;
     }
 }
 
-void apu_ch4_sample(apu_t *apu)
+void apu_ch4_sample(apu_t *apu, i16 level[2])
 {
     if (apu->ch4.enabled)
     {
-        apu->output_left -= AMP_CHL / 2;
-        apu->output_right -= AMP_CHL / 2;
-        apu->output_left += AMP_BASE * apu->ch4.noise.state * apu->ch4.envelope.volume * apu->ch4.left * apu->left_volume;
-        apu->output_right += AMP_BASE * apu->ch4.noise.state * apu->ch4.envelope.volume * apu->ch4.right * apu->right_volume;
+        level[0] = -AMP_CHL / 2 + AMP_BASE * apu->ch4.noise.state * apu->ch4.envelope.volume * apu->ch4.left * apu->left_volume;
+        level[1] = -AMP_CHL / 2 + AMP_BASE * apu->ch4.noise.state * apu->ch4.envelope.volume * apu->ch4.right * apu->right_volume;
     }
 }
 
@@ -540,10 +822,13 @@ void apu_poke(apu_t *apu, u16 address, u8 value)
         apu->nr52 = value;
         apu->enabled = value & 0x80;
         if (!apu->enabled)
-            apu_init(apu, apu->sample_rate, apu->latency);
+            apu_power_off(apu);
         break;
     default:
         printf("[!] unable to write apu address `0x%04X`\n", address);
         exit(EXIT_FAILURE);
     }
+
+    /* volumes, routing & channels switching on or off all show up in the levels */
+    apu_mix(apu, apu->clock);
 }
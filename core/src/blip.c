@@ -0,0 +1,135 @@
+#include "core/blip.h"
+
+#include <math.h>
+#include <string.h>
+
+#define BLIP_CUTOFF 0.9 /* passband, as a fraction of the nyquist frequency */
+#define BLIP_PI 3.14159265358979323846
+
+/* the impulse of a unit step at each sub-sample phase, so adding one up gives a band limited edge */
+static i32 blip_kernel[BLIP_PHASES][BLIP_TAPS];
+static bool blip_kernel_ready;
+
+static void blip_kernel_init(void)
+{
+    for (usize phase = 0; phase < BLIP_PHASES; phase++)
+    {
+        double taps[BLIP_TAPS], total = 0;
+
+        for (usize i = 0; i < BLIP_TAPS; i++)
+        {
+            /* distance from the centre of the step, which lands half the kernel late */
+            double x = (double)i - (double)phase / BLIP_PHASES - BLIP_TAPS / 2;
+            double t = BLIP_PI * BLIP_CUTOFF * x;
+            double sinc = x == 0 ? 1 : sin(t) / t;
+            double window = fabs(x) < BLIP_TAPS / 2 ? 0.42 + 0.5 * cos(2 * BLIP_PI * x / BLIP_TAPS) + 0.08 * cos(4 * BLIP_PI * x / BLIP_TAPS) : 0;
+
+            taps[i] = sinc * window;
+            total += taps[i];
+        }
+
+        /* every phase must add up to exactly one, or each change would leave a little dc behind */
+        i32 sum = 0;
+        for (usize i = 0; i < BLIP_TAPS; i++)
+        {
+            blip_kernel[phase][i] = (i32)lround(taps[i] / total * (1 << BLIP_UNIT));
+            sum += blip_kernel[phase][i];
+        }
+        blip_kernel[phase][BLIP_TAPS / 2] += (1 << BLIP_UNIT) - sum;
+    }
+
+    blip_kernel_ready = true;
+}
+
+void blip_init(blip_t *blip, usize clock_rate, usize sample_rate)
+{
+    if (!blip_kernel_ready)
+        blip_kernel_init();
+
+    memset(blip, 0, sizeof(blip_t));
+    blip->factor = ((u64)sample_rate << 32) / clock_rate;
+}
+
+void blip_add(blip_t *blip, u64 time, i32 delta)
+{
+    if (!delta)
+        return;
+
+    u64 position = blip->offset + (time - blip->clock) * blip->factor;
+    usize index = position >> 32;
+
+    /* past the end means nobody has been reading, the change is lost either way */
+    if (index >= BLIP_SIZE)
+        return;
+
+    const i32 *kernel = blip_kernel[(position & U32_MAX) * BLIP_PHASES >> 32];
+    for (usize i = 0; i < BLIP_TAPS; i++)
+        blip->buffer[index + i] += kernel[i] * delta;
+
+    if (blip->end < index + BLIP_TAPS)
+        blip->end = index + BLIP_TAPS;
+}
+
+void blip_advance(blip_t *blip, u64 time)
+{
+    blip->offset += (time - blip->clock) * blip->factor;
+    blip->clock = time;
+
+    /* keep room for more, dropping the oldest samples if they haven't been read */
+    usize available = blip_available(blip);
+    if (available > BLIP_SIZE / 2)
+        blip_read(blip, NULL, available - BLIP_SIZE / 2, 1);
+}
+
+void blip_skip(blip_t *blip, u64 time)
+{
+    /* carries on from `time` without making samples for the gap */
+    blip->clock = time;
+}
+
+usize blip_available(blip_t *blip)
+{
+    return blip->offset >> 32;
+}
+
+usize blip_read(blip_t *blip, i16 *samples, usize count, usize stride)
+{
+    return blip_integrate(blip, samples, NULL, count, stride);
+}
+
+usize blip_read_f32(blip_t *blip, f32 *samples, usize count, usize stride)
+{
+    return blip_integrate(blip, NULL, samples, count, stride);
+}
+
+usize blip_integrate(blip_t *blip, i16 *samples_i16, f32 *samples_f32, usize count, usize stride)
+{
+    usize available = blip_available(blip);
+    if (count > available)
+        count = available;
+
+    i32 sum = blip->sum;
+    for (usize i = 0; i < count; i++)
+    {
+        sum += blip->buffer[i];
+
+        i32 sample = sum >> BLIP_UNIT;
+        if (samples_i16)
+            samples_i16[i * stride] = sample < I16_MIN ? I16_MIN : sample > I16_MAX ? I16_MAX : sample;
+        if (samples_f32)
+            samples_f32[i * stride] = sample / 32768.0f;
+
+        /* high pass, so a channel switching on or off doesn't leave an offset behind */
+        sum -= sample * (1 << (BLIP_UNIT - BLIP_BASS));
+    }
+    blip->sum = sum;
+
+    /* move what's left, including the tails of steps still to be read, to the front */
+    usize end = blip->end > count ? blip->end : count;
+    memmove(blip->buffer, blip->buffer + count, (end - count) * sizeof(i32));
+    memset(blip->buffer + end - count, 0, count * sizeof(i32));
+
+    blip->end = end - count;
+    blip->offset -= (u64)count << 32;
+    return count;
+}
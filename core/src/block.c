@@ -0,0 +1,270 @@
+#include "core/block.h"
+
+#include <stdlib.h>
+#include "core/mmu.h"
+
+/* instructions (and their operands) can't straddle the fixed & switchable rom banks */
+#define BLOCK_REGION_END(pc) ((pc) < MMAP_ROM_01 ? MMAP_ROM_01 : MMAP_VRAM)
+
+/* registers an op depends on or changes, (hl) operands count as reading h & l */
+#define REG_A BIT(0)
+#define REG_F BIT(1)
+#define REG_B BIT(2)
+#define REG_C BIT(3)
+#define REG_D BIT(4)
+#define REG_E BIT(5)
+#define REG_H BIT(6)
+#define REG_L BIT(7)
+
+/* indexed by the 3 bit register field of an opcode, b, c, d, e, h, l, (hl), a */
+static const u8 block_registers[8] = {REG_B, REG_C, REG_D, REG_E, REG_H, REG_L, REG_H | REG_L, REG_A};
+
+void block_cache_init(block_cache_t *cache)
+{
+    cache->blocks = (block_t *)malloc(sizeof(block_t) * BLOCK_CACHE_SIZE);
+    block_cache_flush(cache);
+}
+
+void block_cache_free(block_cache_t *cache)
+{
+    free(cache->blocks);
+}
+
+void block_cache_flush(block_cache_t *cache)
+{
+    for (usize i = 0; i < BLOCK_CACHE_SIZE; i++)
+        cache->blocks[i].valid = false;
+}
+
+block_t *block_lookup(block_cache_t *cache, bus_t *bus, u16 pc)
+{
+    /* only rom is cached, code running from ram goes through the interpreter */
+    if (pc >= MMAP_VRAM || BLOCK_REGION_END(pc) - pc < 3)
+        return NULL;
+
+    u16 bank = pc < MMAP_ROM_01 ? 0 : bus->mmu->rom_bank;
+    block_t *block = &cache->blocks[(pc ^ (bank << 7)) & (BLOCK_CACHE_SIZE - 1)];
+
+    if (!block->valid || block->pc != pc || block->bank != bank)
+        block_decode(block, bus, pc, bank);
+
+    return block;
+}
+
+void block_decode(block_t *block, bus_t *bus, u16 pc, u16 bank)
+{
+    u16 region_end = BLOCK_REGION_END(pc);
+
+    block->valid = true;
+    block->pc = pc;
+    block->bank = bank;
+    block->length = 0;
+    block->code = NULL;
+    block->hits = 0;
+    block->idle = false;
+
+    while (block->length < BLOCK_MAX_OPS)
+    {
+        block_op_t *op = &block->ops[block->length++];
+        op->opcode = mmu_peek(bus->mmu, pc);
+        op->imm16 = mmu_peek(bus->mmu, pc + 1) | (mmu_peek(bus->mmu, pc + 2) << 8);
+
+        /* the cb prefix is listed as a single byte, but always carries its sub-opcode */
+        pc += op->opcode == 0xCB ? 2 : opc_opcodes[op->opcode].length;
+
+        /* stop at control flow, or where the next instruction could come from another bank */
+        if (block_ends(op->opcode) || region_end - pc < 3)
+            break;
+    }
+
+    block->idle = block_spins(block, pc);
+}
+
+bool block_ends(u8 opcode)
+{
+    switch (opcode)
+    {
+    case 0x10: /* stop 0 */
+    case 0x18: /* jr r8 */
+    case 0x20: /* jr nz, r8 */
+    case 0x28: /* jr z, r8 */
+    case 0x30: /* jr nc, r8 */
+    case 0x38: /* jr c, r8 */
+    case 0x76: /* halt */
+    case 0xC0: /* ret nz */
+    case 0xC2: /* jp nz, a16 */
+    case 0xC3: /* jp a16 */
+    case 0xC4: /* call nz, a16 */
+    case 0xC7: /* rst 00h */
+    case 0xC8: /* ret z */
+    case 0xC9: /* ret */
+    case 0xCA: /* jp z, a16 */
+    case 0xCC: /* call z, a16 */
+    case 0xCD: /* call a16 */
+    case 0xCF: /* rst 08h */
+    case 0xD0: /* ret nc */
+    case 0xD2: /* jp nc, a16 */
+    case 0xD4: /* call nc, a16 */
+    case 0xD7: /* rst 10h */
+    case 0xD8: /* ret c */
+    case 0xD9: /* reti */
+    case 0xDA: /* jp c, a16 */
+    case 0xDC: /* call c, a16 */
+    case 0xDF: /* rst 18h */
+    case 0xE7: /* rst 20h */
+    case 0xE9: /* jp hl */
+    case 0xEF: /* rst 28h */
+    case 0xF3: /* di */
+    case 0xF7: /* rst 30h */
+    case 0xFB: /* ei */
+    case 0xFF: /* rst 38h */
+        return true;
+    default:
+        /* undefined opcodes fault, so they end the block too */
+        return opc_opcodes[opcode].cycles == 0;
+    }
+}
+
+bool block_spins(block_t *block, u16 end)
+{
+    block_op_t *last = &block->ops[block->length - 1];
+    u8 read = 0, written = 0;
+
+    /* has to branch straight back to its own start */
+    switch (last->opcode)
+    {
+    case 0x18: /* jr r8 */
+    case 0x20: /* jr nz, r8 */
+    case 0x28: /* jr z, r8 */
+    case 0x30: /* jr nc, r8 */
+    case 0x38: /* jr c, r8 */
+        if ((u16)(end + (i8)last->imm16) != block->pc)
+            return false;
+        break;
+    case 0xC2: /* jp nz, a16 */
+    case 0xC3: /* jp a16 */
+    case 0xCA: /* jp z, a16 */
+    case 0xD2: /* jp nc, a16 */
+    case 0xDA: /* jp c, a16 */
+        if (last->imm16 != block->pc)
+            return false;
+        break;
+    default:
+        return false;
+    }
+
+    for (usize i = 0; i < block->length; i++)
+    {
+        u8 reads, writes;
+
+        if (!block_op_registers(&block->ops[i], &reads, &writes))
+            return false;
+
+        read |= reads & ~written;
+        written |= writes;
+    }
+
+    /* anything carried over from the previous time round would make each pass different */
+    return !(read & written);
+}
+
+bool block_op_registers(block_op_t *op, u8 *reads, u8 *writes)
+{
+    u8 opcode = op->opcode;
+
+    *reads = 0;
+    *writes = 0;
+
+    /* ld r, r & ld r, (hl), but not stores through hl or halt */
+    if (opcode >= 0x40 && opcode < 0x80)
+    {
+        if ((opcode & 0x38) == 0x30)
+            return false;
+
+        *reads = block_registers[opcode & 7];
+        *writes = block_registers[(opcode >> 3) & 7];
+        return true;
+    }
+
+    /* alu a, r & alu a, (hl) */
+    if (opcode >= 0x80 && opcode < 0xC0)
+    {
+        u8 alu = (opcode >> 3) & 7;
+
+        *reads = REG_A | block_registers[opcode & 7] | (alu == 1 || alu == 3 ? REG_F : 0);
+        *writes = REG_F | (alu == 7 ? 0 : REG_A);
+        return true;
+    }
+
+    switch (opcode)
+    {
+    case 0x00: /* nop */
+    case 0x18: /* jr r8 */
+    case 0xC3: /* jp a16 */
+        return true;
+    case 0x20: /* jr nz, r8 */
+    case 0x28: /* jr z, r8 */
+    case 0x30: /* jr nc, r8 */
+    case 0x38: /* jr c, r8 */
+    case 0xC2: /* jp nz, a16 */
+    case 0xCA: /* jp z, a16 */
+    case 0xD2: /* jp nc, a16 */
+    case 0xDA: /* jp c, a16 */
+        *reads = REG_F;
+        return true;
+    case 0x06: /* ld b, d8 */
+    case 0x0E: /* ld c, d8 */
+    case 0x16: /* ld d, d8 */
+    case 0x1E: /* ld e, d8 */
+    case 0x26: /* ld h, d8 */
+    case 0x2E: /* ld l, d8 */
+    case 0x3E: /* ld a, d8 */
+        *writes = block_registers[(opcode >> 3) & 7];
+        return true;
+    case 0x0A: /* ld a, (bc) */
+        *reads = REG_B | REG_C;
+        *writes = REG_A;
+        return true;
+    case 0x1A: /* ld a, (de) */
+        *reads = REG_D | REG_E;
+        *writes = REG_A;
+        return true;
+    case 0xF0: /* ldh a, (a8) */
+    case 0xFA: /* ld a, (a16) */
+        *writes = REG_A;
+        return true;
+    case 0xF2: /* ld a, (c) */
+        *reads = REG_C;
+        *writes = REG_A;
+        return true;
+    case 0xC6: /* add a, d8 */
+    case 0xD6: /* sub d8 */
+    case 0xE6: /* and d8 */
+    case 0xEE: /* xor d8 */
+    case 0xF6: /* or d8 */
+        *reads = REG_A;
+        *writes = REG_A | REG_F;
+        return true;
+    case 0xCE: /* adc a, d8 */
+    case 0xDE: /* sbc a, d8 */
+        *reads = REG_A | REG_F;
+        *writes = REG_A | REG_F;
+        return true;
+    case 0xFE: /* cp d8 */
+        *reads = REG_A;
+        *writes = REG_F;
+        return true;
+    case 0xCB:
+        /* bit n, r leaves carry alone, so it counts as reading the flags too */
+        if ((u8)op->imm16 >= 0x40 && (u8)op->imm16 < 0x80)
+        {
+            *reads = block_registers[op->imm16 & 7] | REG_F;
+            *writes = REG_F;
+            return true;
+        }
+        return false;
+    default:
+        /* anything that writes memory, touches the stack or changes interrupts could end the loop by itself */
+        return false;
+    }
+}
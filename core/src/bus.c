@@ -3,19 +3,29 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include "core/apu.h"
+#include "core/cpu.h"
 #include "core/mmu.h"
 #include "core/ppu.h"
+#include "core/sched.h"
 
-void bus_init(bus_t *bus, cpu_t *cpu, apu_t *apu, mmu_t *mmu, ppu_t *ppu)
+void bus_init(bus_t *bus, cpu_t *cpu, apu_t *apu, mmu_t *mmu, ppu_t *ppu, sched_t *sched)
 {
     bus->cpu = cpu;
     bus->apu = apu;
     bus->mmu = mmu;
     bus->ppu = ppu;
+    bus->sched = sched;
 }
 
 u8 bus_peek8(bus_t *bus, u16 address)
 {
+    /* the timers are only brought up to date when they're read */
+    if (address == MMAP_IO_DIV || address == MMAP_IO_TIMA)
+    {
+        cpu_sync_timers(bus->cpu, bus);
+        bus->cpu->clock.timer_read = true;
+    }
+
     /* apu memory map */
     if (address >= MMAP_IO_NR10 && address <= MMAP_IO_NR52)
     {
@@ -33,15 +43,55 @@ u16 bus_peek16(bus_t *bus, u16 address)
 
 void bus_poke8(bus_t *bus, u16 address, u8 value)
 {
+    /* writes during mode 3 land mid-line, the fifo ppu draws up to now & the scanline one notes where they fall */
+    if (bus->ppu->mode == MODE_LCD_TRANSFER)
+    {
+        if (bus->ppu->renderer == PPU_RENDERER_FIFO)
+            ppu_sync(bus->ppu, bus, address);
+        else
+            ppu_log_write(bus->ppu, bus, address, value);
+    }
+
     /* apu memory map */
     if (address >= MMAP_IO_NR10 && address <= MMAP_IO_NR52)
     {
+        /* bring the channels up to date before their registers change */
+        apu_sync(bus->apu, bus);
         apu_poke(bus->apu, address, value);
+
+        if (address == MMAP_IO_NR52)
+            apu_schedule(bus->apu, bus);
         return;
     }
+    if (address >= MMAP_IO_WAVE && address < MMAP_IO_WAVE + 0x10)
+    {
+        apu_sync(bus->apu, bus);
+    }
+
+    /* timer writes land on values that are up to date */
+    if (address >= MMAP_IO_DIV && address <= MMAP_IO_TAC)
+        cpu_sync_timers(bus->cpu, bus);
 
     /* default back to mmu */
     mmu_poke(bus->mmu, address, value);
+
+    /* timer writes move the overflow */
+    switch (address)
+    {
+    case MMAP_IO_DIV:
+    case MMAP_IO_TIMA:
+    case MMAP_IO_TAC:
+        cpu_reset_timers(bus->cpu, bus, address);
+        cpu_schedule_tima(bus->cpu, bus);
+        break;
+    case MMAP_IO_LCDC:
+        /* lcdc.7 starts & stops the ppu */
+        if ((value & 0x80) && !bus->ppu->enabled)
+            ppu_enable(bus->ppu, bus);
+        else if (!(value & 0x80) && bus->ppu->enabled)
+            ppu_disable(bus->ppu, bus);
+        break;
+    }
 }
 
 void bus_poke16(bus_t *bus, u16 address, u16 value)
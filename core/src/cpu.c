@@ -5,13 +5,15 @@
 #include "core/apu.h"
 #include "core/mmu.h"
 #include "core/ppu.h"
+#include "core/sched.h"
 
 usize tac_cycles[4] = {1024, 16, 64, 256};
 
-void cpu_init(cpu_t *cpu, bool is_cgb)
+void cpu_init(cpu_t *cpu, bool is_cgb, cpu_backend_t backend)
 {
 	/* setup registers */
 	cpu->registers.af = 0x01B0;
+	cpu_flags_set(cpu, cpu->registers.f);
 	cpu->registers.bc = 0x0013;
 	cpu->registers.de = 0x00D8;
 	cpu->registers.hl = 0x014D;
@@ -21,6 +23,9 @@ void cpu_init(cpu_t *cpu, bool is_cgb)
 
 	/* setup clock */
 	cpu->clock.cycles = 0;
+	cpu->clock.div_tick = 0;
+	cpu->clock.tima_tick = 0;
+	cpu->clock.timer_read = false;
 
 	/* setup interrupts */
 	cpu->interrupt.pending = 0;
@@ -36,6 +41,21 @@ void cpu_init(cpu_t *cpu, bool is_cgb)
 	{
 		cpu->registers.a = 0x11;
 	}
+
+	/* decoded block cache */
+	block_cache_init(&cpu->cache);
+
+	/* execution backend, the jit falls back to the interpreter if it can't get executable memory */
+	cpu->backend = backend;
+	cpu->jit.code = NULL;
+	if (backend == CPU_BACKEND_JIT && !jit_init(&cpu->jit))
+		cpu->backend = CPU_BACKEND_INTERPRETER;
+}
+
+void cpu_free(cpu_t *cpu)
+{
+	jit_free(&cpu->jit);
+	block_cache_free(&cpu->cache);
 }
 
 void cpu_fault(cpu_t *cpu, bus_t *bus, opc_t *opc, const char *message)
@@ -70,7 +90,7 @@ void cpu_stack_trace(cpu_t *cpu, bus_t *bus)
 
 void cpu_dump(cpu_t *cpu)
 {
-	printf("	af: %04X\n", cpu->registers.af);
+	printf("	af: %04X\n", cpu->registers.a << 8 | cpu_flags_get(cpu));
 	printf("	bc: %04X\n", cpu->registers.bc);
 	printf("	de: %04X\n", cpu->registers.de);
 	printf("	hl: %04X\n", cpu->registers.hl);
@@ -112,49 +132,37 @@ void cpu_ret(cpu_t *cpu, bus_t *bus)
 
 void cpu_add(cpu_t *cpu, bus_t *bus, u8 value)
 {
-	u32 result = cpu->registers.a + value;
+	u16 result = cpu->registers.a + value;
 
-	cpu->registers.flag_z = IS_ZERO(result & 0xFF);
-	cpu->registers.flag_n = false;
-	cpu->registers.flag_h = ((cpu->registers.a & 0xF) + (value & 0xF)) > 0xF;
-	cpu->registers.flag_c = (result & 0x100) != 0;
+	cpu_flags_result(cpu, result, cpu->registers.a ^ value, false);
 
 	cpu->registers.a = (u8)result;
 }
 
 void cpu_adc(cpu_t *cpu, bus_t *bus, u8 value)
 {
-	u32 result_full = cpu->registers.a + value + cpu->registers.flag_c;
-	u8 result = result_full;
+	u16 result = cpu->registers.a + value + cpu_flag_c(cpu);
 
-	cpu->registers.flag_z = IS_ZERO(result);
-	cpu->registers.flag_n = false;
-	cpu->registers.flag_h = ((cpu->registers.a & 0xF) + (value & 0xF) + cpu->registers.flag_c) > 0xF;
-	cpu->registers.flag_c = result_full > 0xFF;
+	cpu_flags_result(cpu, result, cpu->registers.a ^ value, false);
 
-	cpu->registers.a = result;
+	cpu->registers.a = (u8)result;
 }
 
 void cpu_sbc(cpu_t *cpu, bus_t *bus, u8 value)
 {
-	i32 result_full = cpu->registers.a - value - cpu->registers.flag_c;
-	u8 result = result_full;
+	/* a borrow wraps the result round, which sets bit 8 */
+	u16 result = cpu->registers.a - value - cpu_flag_c(cpu);
 
-	cpu->registers.flag_z = IS_ZERO(result);
-	cpu->registers.flag_n = true;
-	cpu->registers.flag_h = ((cpu->registers.a & 0xF) - (value & 0xF) - cpu->registers.flag_c) < 0;
-	cpu->registers.flag_c = result_full < 0;
+	cpu_flags_result(cpu, result, cpu->registers.a ^ value, true);
 
-	cpu->registers.a = result;
+	cpu->registers.a = (u8)result;
 }
 
 void cpu_add_hl(cpu_t *cpu, bus_t *bus, u16 value)
 {
 	u32 result = cpu->registers.hl + value;
 
-	cpu->registers.flag_n = false;
-	cpu->registers.flag_h = (cpu->registers.hl & 0xFFF) + (value & 0xFFF) > 0xFFF;
-	cpu->registers.flag_c = (result & 0x10000) != 0;
+	cpu_flags(cpu, cpu_flag_z(cpu), false, (cpu->registers.hl & 0xFFF) + (value & 0xFFF) > 0xFFF, (result & 0x10000) != 0);
 
 	cpu->registers.hl = result;
 }
@@ -162,46 +170,81 @@ void cpu_add_hl(cpu_t *cpu, bus_t *bus, u16 value)
 void cpu_add_sp(cpu_t *cpu, bus_t *bus, u8 value)
 {
 	i32 result = cpu->registers.sp + (i8)value;
+	i32 carry = cpu->registers.sp ^ (i8)value ^ (result & 0xFFFF);
 
-	cpu->registers.flag_z = false;
-	cpu->registers.flag_n = false;
-	cpu->registers.flag_h = ((cpu->registers.sp ^ (i8)value ^ (result & 0xFFFF)) & 0x10) == 0x10;
-	cpu->registers.flag_c = ((cpu->registers.sp ^ (i8)value ^ (result & 0xFFFF)) & 0x100) == 0x100;
+	cpu_flags(cpu, false, false, (carry & 0x10) == 0x10, (carry & 0x100) == 0x100);
 
 	cpu->registers.sp = result;
 }
 
 void cpu_sub(cpu_t *cpu, bus_t *bus, u8 value)
 {
-	i32 result = cpu->registers.a - value;
-	i32 carry = cpu->registers.a ^ value ^ result;
+	u16 result = cpu->registers.a - value;
+
+	cpu_flags_result(cpu, result, cpu->registers.a ^ value, true);
 
 	cpu->registers.a = (u8)result;
+}
 
-	cpu->registers.flag_z = IS_ZERO(result);
-	cpu->registers.flag_n = true;
-	cpu->registers.flag_h = !IS_ZERO(carry & 0x10);
-	cpu->registers.flag_c = !IS_ZERO(carry & 0x100);
+void cpu_cp(cpu_t *cpu, bus_t *bus, u8 value)
+{
+	cpu_flags_result(cpu, (u16)(cpu->registers.a - value), cpu->registers.a ^ value, true);
+}
+
+void cpu_and(cpu_t *cpu, bus_t *bus, u8 value)
+{
+	cpu->registers.a &= value;
+
+	/* half carry is always set */
+	cpu_flags_result(cpu, cpu->registers.a, cpu->registers.a ^ 0x10, false);
+}
+
+void cpu_xor(cpu_t *cpu, bus_t *bus, u8 value)
+{
+	cpu->registers.a ^= value;
+
+	cpu_flags_result(cpu, cpu->registers.a, cpu->registers.a, false);
+}
+
+void cpu_or(cpu_t *cpu, bus_t *bus, u8 value)
+{
+	cpu->registers.a |= value;
+
+	cpu_flags_result(cpu, cpu->registers.a, cpu->registers.a, false);
+}
+
+void cpu_inc(cpu_t *cpu, bus_t *bus, u8 *reg)
+{
+	u8 value = *reg;
+
+	(*reg)++;
+
+	/* carry is left alone */
+	cpu_flags_result(cpu, *reg | (cpu_flag_c(cpu) << 8), value ^ 1, false);
 }
 
 void cpu_dec(cpu_t *cpu, bus_t *bus, u8 *reg)
 {
+	u8 value = *reg;
+
 	(*reg)--;
 
-	cpu->registers.flag_z = IS_ZERO(*reg);
-	cpu->registers.flag_n = true;
-	cpu->registers.flag_h = (*reg & 0xF) == 0xF;
+	/* carry is left alone */
+	cpu_flags_result(cpu, *reg | (cpu_flag_c(cpu) << 8), value ^ 1, true);
+}
+
+void cpu_bit(cpu_t *cpu, bus_t *bus, u8 value, u8 mask)
+{
+	cpu_flags(cpu, !(value & mask), false, true, cpu_flag_c(cpu));
 }
 
+/* shifts & rotates clear n & h, so the result doubles as the operands */
+
 u8 cpu_rl(cpu_t *cpu, bus_t *bus, u8 val)
 {
-	bool c = GET_BIT(val, 7);
-	u8 r = (val << 1) | cpu->registers.flag_c;
+	u8 r = (val << 1) | cpu_flag_c(cpu);
 
-	cpu->registers.flag_z = IS_ZERO(r);
-	cpu->registers.flag_n = false;
-	cpu->registers.flag_h = false;
-	cpu->registers.flag_c = c;
+	cpu_flags_result(cpu, r | ((val & 0x80) << 1), r, false);
 
 	return r;
 }
@@ -213,21 +256,14 @@ void cpu_rlc(cpu_t *cpu, bus_t *bus, u8 *reg)
 
 	*reg = result;
 
-	cpu->registers.flag_z = IS_ZERO(result);
-	cpu->registers.flag_n = false;
-	cpu->registers.flag_h = false;
-	cpu->registers.flag_c = carry_flag;
+	cpu_flags_result(cpu, result | (carry_flag << 8), result, false);
 }
 
 u8 cpu_rr(cpu_t *cpu, bus_t *bus, u8 val)
 {
-	u8 c = val & 0x1;
-	u8 r = (val >> 1) | (cpu->registers.flag_c ? 0x80 : 0x00);
+	u8 r = (val >> 1) | (cpu_flag_c(cpu) << 7);
 
-	cpu->registers.flag_z = IS_ZERO(r);
-	cpu->registers.flag_n = false;
-	cpu->registers.flag_h = false;
-	cpu->registers.flag_c = c;
+	cpu_flags_result(cpu, r | ((val & 0x1) << 8), r, false);
 
 	return r;
 }
@@ -239,47 +275,41 @@ void cpu_rrc(cpu_t *cpu, bus_t *bus, u8 *reg)
 
 	*reg = result;
 
-	cpu->registers.flag_z = IS_ZERO(result);
-	cpu->registers.flag_n = false;
-	cpu->registers.flag_h = false;
-	cpu->registers.flag_c = carry_flag;
+	cpu_flags_result(cpu, result | (carry_flag << 8), result, false);
 }
 
 u8 cpu_sla(cpu_t *cpu, bus_t *bus, u8 val)
 {
-	u8 c = GET_BIT(val, 7);
 	u8 r = val << 1;
 
-	cpu->registers.flag_z = IS_ZERO(r);
-	cpu->registers.flag_n = false;
-	cpu->registers.flag_h = false;
-	cpu->registers.flag_c = c;
+	cpu_flags_result(cpu, r | ((val & 0x80) << 1), r, false);
 
 	return r;
 }
 
 u8 cpu_sra(cpu_t *cpu, bus_t *bus, u8 val)
 {
-	u8 c = val & 0x1;
 	u8 r = (val >> 1) | (val & 0x80);
 
-	cpu->registers.flag_z = IS_ZERO(r);
-	cpu->registers.flag_n = false;
-	cpu->registers.flag_h = false;
-	cpu->registers.flag_c = c;
+	cpu_flags_result(cpu, r | ((val & 0x1) << 8), r, false);
 
 	return r;
 }
 
 u8 cpu_srl(cpu_t *cpu, bus_t *bus, u8 val)
 {
-	u8 c = val & 0x1;
 	u8 r = val >> 1;
 
-	cpu->registers.flag_z = IS_ZERO(r);
-	cpu->registers.flag_n = false;
-	cpu->registers.flag_h = false;
-	cpu->registers.flag_c = c;
+	cpu_flags_result(cpu, r | ((val & 0x1) << 8), r, false);
+
+	return r;
+}
+
+u8 cpu_swap(cpu_t *cpu, bus_t *bus, u8 val)
+{
+	u8 r = (val << 4) | (val >> 4);
+
+	cpu_flags_result(cpu, r, r, false);
 
 	return r;
 }
@@ -287,12 +317,11 @@ u8 cpu_srl(cpu_t *cpu, bus_t *bus, u8 val)
 void cpu_ld_hl(cpu_t *cpu, bus_t *bus, u8 value)
 {
 	i32 result = cpu->registers.sp + (i8)value;
+	i32 carry = cpu->registers.sp ^ (i8)value ^ (result & 0xFFFF);
+
 	cpu->registers.hl = result;
 
-	cpu->registers.flag_z = false;
-	cpu->registers.flag_n = false;
-	cpu->registers.flag_h = ((cpu->registers.sp ^ (i8)value ^ (result & 0xFFFF)) & 0x10) == 0x10;
-	cpu->registers.flag_c = ((cpu->registers.sp ^ (i8)value ^ (result & 0xFFFF)) & 0x100) == 0x100;
+	cpu_flags(cpu, false, false, (carry & 0x10) == 0x10, (carry & 0x100) == 0x100);
 }
 
 void cpu_execute(cpu_t *cpu, bus_t *bus, u8 opcode)
@@ -304,9 +333,69 @@ void cpu_execute(cpu_t *cpu, bus_t *bus, u8 opcode)
 		return; /* don't execute while copying */
 	}
 
-	/* decode opcode & immediate values */
+	/* decode immediate values, only reading the bytes which belong to the instruction */
+	u16 imm16 = 0;
+	if (opc_opcodes[opcode].length > 1 || opcode == 0xCB)
+		imm16 = bus_peek16(bus, cpu->registers.pc + 1);
+
+	cpu_execute_op(cpu, bus, opcode, imm16);
+}
+
+void cpu_execute_block(cpu_t *cpu, bus_t *bus, block_t *block)
+{
+	u32 cycles = 0;
+
+	for (usize i = 0; i < block->length; i++)
+	{
+		cpu_execute_op(cpu, bus, block->ops[i].opcode, block->ops[i].imm16);
+		cycles += cpu->clock.cycles;
+
+		if (cpu_retire(cpu, bus, block->bank))
+			break;
+	}
+
+	/* the caller advances time by the whole block */
+	bus->sched->now -= cycles / 4;
+	cpu->clock.cycles = cycles;
+}
+
+bool cpu_retire(cpu_t *cpu, bus_t *bus, u16 bank)
+{
+	/* keep time current for any register writes that sync against it */
+	bus->sched->now += cpu->clock.cycles / 4;
+
+	/* hand back to the main loop whenever it would have done something between instructions */
+	return bus->sched->now >= bus->sched->next || cpu_interrupted(cpu, bus, bank);
+}
+
+bool cpu_interrupted(cpu_t *cpu, bus_t *bus, u16 bank)
+{
+	if (cpu->interrupt.master && (bus->mmu->memory.interrupt_enable & bus->mmu->io.irf))
+		return true;
+
+	/* a write may have started a dma, or swapped out the bank we're running from */
+	return bus->mmu->hdma.to_copy > 0 || (bank && bank != bus->mmu->rom_bank);
+}
+
+void cpu_skip_idle(cpu_t *cpu, bus_t *bus)
+{
+	/* an interrupt is about to be taken instead, or the loop is polling a timer, which changes between events */
+	if (cpu->interrupt.master && (bus->mmu->memory.interrupt_enable & bus->mmu->io.irf))
+		return;
+	if (cpu->clock.timer_read)
+		return;
+
+	u64 pass = cpu->clock.cycles / 4;
+	u64 end = bus->sched->now + pass;
+
+	/* every pass that finishes before the next event reads the same values & takes the same branch */
+	if (pass && end < bus->sched->next)
+		cpu->clock.cycles += (u32)((bus->sched->next - end - 1) / pass * pass * 4);
+}
+
+void cpu_execute_op(cpu_t *cpu, bus_t *bus, u8 opcode, u16 imm16)
+{
 	opc_t *opc = &opc_opcodes[opcode];
-	u16 imm16 = bus_peek16(bus, cpu->registers.pc + 1);
 	u8 imm8 = (u8)imm16;
 
 	/* update state */
@@ -332,10 +421,7 @@ void cpu_execute(cpu_t *cpu, bus_t *bus, u8 opcode)
 		cpu->registers.bc++;
 		break;
 	case 0x04: /* inc b */
-		cpu->registers.b++;
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.b);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = (cpu->registers.b & 0xF) < ((cpu->registers.b - 1) & 0xF);
+		cpu_inc(cpu, bus, &cpu->registers.b);
 		break;
 	case 0x05: /* dec b */
 		cpu_dec(cpu, bus, &cpu->registers.b);
@@ -344,8 +430,9 @@ void cpu_execute(cpu_t *cpu, bus_t *bus, u8 opcode)
 		cpu->registers.b = imm8;
 		break;
 	case 0x07: /* rlca */
-		cpu_rlc(cpu, bus, &cpu->registers.a);
-		cpu->registers.flag_z = false;
+		tmp8 = cpu->registers.a >> 7;
+		cpu->registers.a = (cpu->registers.a << 1) | tmp8;
+		cpu_flags(cpu, false, false, false, tmp8);
 		break;
 	case 0x08: /* ld (a16), sp */
 		bus_poke16(bus, imm16, cpu->registers.sp);
@@ -360,10 +447,7 @@ void cpu_execute(cpu_t *cpu, bus_t *bus, u8 opcode)
 		cpu->registers.bc--;
 		break;
 	case 0x0C: /* inc c */
-		cpu->registers.c++;
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.c);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = (cpu->registers.c & 0xF) < ((cpu->registers.c - 1) & 0xF);
+		cpu_inc(cpu, bus, &cpu->registers.c);
 		break;
 	case 0x0D: /* dec c */
 		cpu_dec(cpu, bus, &cpu->registers.c);
@@ -372,10 +456,12 @@ void cpu_execute(cpu_t *cpu, bus_t *bus, u8 opcode)
 		cpu->registers.c = imm8;
 		break;
 	case 0x0F: /* rrca */
-		cpu_rrc(cpu, bus, &cpu->registers.a);
-		cpu->registers.flag_z = false;
+		tmp8 = cpu->registers.a & 0x1;
+		cpu->registers.a = (cpu->registers.a >> 1) | (tmp8 << 7);
+		cpu_flags(cpu, false, false, false, tmp8);
 		break;
 	case 0x10: /* stop 0 */
+		cpu_sync_timers(cpu, bus);
 		if (cpu->cgb.enabled)
 		{
 			if (bus->mmu->io.prepare_speed_switch & 0x1)
@@ -400,8 +486,11 @@ void cpu_execute(cpu_t *cpu, bus_t *bus, u8 opcode)
 			//			cpu->stopped = true;
 		}
 
-		/* reset div timer */
+		/* reset div timer, the timer periods may also have changed with the speed */
 		bus->mmu->io.div = 0;
+		cpu_reset_timers(cpu, bus, MMAP_IO_DIV);
+		cpu_reset_timers(cpu, bus, MMAP_IO_TAC);
+		cpu_schedule_tima(cpu, bus);
 		break;
 	case 0x11: /* ld de, d16 */
 		cpu->registers.de = imm16;
@@ -413,10 +502,7 @@ void cpu_execute(cpu_t *cpu, bus_t *bus, u8 opcode)
 		cpu->registers.de++;
 		break;
 	case 0x14: /* inc d */
-		cpu->registers.d++;
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.d);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = (cpu->registers.d & 0xF) < ((cpu->registers.d - 1) & 0xF);
+		cpu_inc(cpu, bus, &cpu->registers.d);
 		break;
 	case 0x15: /* dec d */
 		cpu_dec(cpu, bus, &cpu->registers.d);
@@ -425,8 +511,9 @@ void cpu_execute(cpu_t *cpu, bus_t *bus, u8 opcode)
 		cpu->registers.d = imm8;
 		break;
 	case 0x17: /* rla */
-		cpu->registers.a = cpu_rl(cpu, bus, cpu->registers.a);
-		cpu->registers.flag_z = false;
+		tmp8 = cpu->registers.a >> 7;
+		cpu->registers.a = (cpu->registers.a << 1) | cpu_flag_c(cpu);
+		cpu_flags(cpu, false, false, false, tmp8);
 		break;
 	case 0x18: /* jr r8 */
 		cpu->registers.pc += (i8)imm8;
@@ -441,10 +528,7 @@ void cpu_execute(cpu_t *cpu, bus_t *bus, u8 opcode)
 		cpu->registers.de--;
 		break;
 	case 0x1C: /* inc e */
-		cpu->registers.e++;
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.e);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = (cpu->registers.e & 0xF) < ((cpu->registers.e - 1) & 0xF);
+		cpu_inc(cpu, bus, &cpu->registers.e);
 		break;
 	case 0x1D: /* dec e */
 		cpu_dec(cpu, bus, &cpu->registers.e);
@@ -454,14 +538,11 @@ void cpu_execute(cpu_t *cpu, bus_t *bus, u8 opcode)
 		break;
 	case 0x1F: /* rra */
 		tmp8 = cpu->registers.a & 0x1;
-		cpu->registers.a = (cpu->registers.a >> 1) | (cpu->registers.flag_c << 7);
-		cpu->registers.flag_z = false;
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = false;
-		cpu->registers.flag_c = tmp8;
+		cpu->registers.a = (cpu->registers.a >> 1) | (cpu_flag_c(cpu) << 7);
+		cpu_flags(cpu, false, false, false, tmp8);
 		break;
 	case 0x20: /* jr nz, r8 */
-		if (!cpu->registers.flag_z)
+		if (!cpu_flag_z(cpu))
 		{
 			cpu->registers.pc += (i8)imm8;
 			cpu->clock.cycles += 4;
@@ -477,10 +558,7 @@ void cpu_execute(cpu_t *cpu, bus_t *bus, u8 opcode)
 		cpu->registers.hl++;
 		break;
 	case 0x24: /* inc h */
-		cpu->registers.h++;
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.h);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = (cpu->registers.h & 0xF) < ((cpu->registers.h - 1) & 0xF);
+		cpu_inc(cpu, bus, &cpu->registers.h);
 		break;
 	case 0x25: /* dec h */
 		cpu_dec(cpu, bus, &cpu->registers.h);
@@ -489,31 +567,31 @@ void cpu_execute(cpu_t *cpu, bus_t *bus, u8 opcode)
 		cpu->registers.h = imm8;
 		break;
 	case 0x27: /* daa */
-		if (!cpu->registers.flag_n)
+		tmp8 = cpu_flag_c(cpu);
+		if (!cpu_flag_n(cpu))
 		{
-			if (cpu->registers.flag_c || cpu->registers.a > 0x99)
+			if (tmp8 || cpu->registers.a > 0x99)
 			{
 				cpu->registers.a += 0x60;
-				cpu->registers.flag_c = true;
+				tmp8 = true;
 			}
-			if (cpu->registers.flag_h || (cpu->registers.a & 0xF) > 0x9)
+			if (cpu_flag_h(cpu) || (cpu->registers.a & 0xF) > 0x9)
 			{
 				cpu->registers.a += 0x6;
 			}
 		}
 		else
 		{
-			if (cpu->registers.flag_c)
+			if (tmp8)
 				cpu->registers.a -= 0x60;
-			if (cpu->registers.flag_h)
+			if (cpu_flag_h(cpu))
 				cpu->registers.a -= 0x6;
 		}
 
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.a);
-		cpu->registers.flag_h = false;
+		cpu_flags(cpu, IS_ZERO(cpu->registers.a), cpu_flag_n(cpu), false, tmp8);
 		break;
 	case 0x28: /* jr z, r8 */
-		if (cpu->registers.flag_z)
+		if (cpu_flag_z(cpu))
 		{
 			cpu->registers.pc += (i8)imm8;
 			cpu->clock.cycles += 4;
@@ -529,10 +607,7 @@ void cpu_execute(cpu_t *cpu, bus_t *bus, u8 opcode)
 		cpu->registers.hl--;
 		break;
 	case 0x2C: /* inc l */
-		cpu->registers.l++;
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.l);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = (cpu->registers.l & 0xF) < ((cpu->registers.l - 1) & 0xF);
+		cpu_inc(cpu, bus, &cpu->registers.l);
 		break;
 	case 0x2D: /* dec l */
 		cpu_dec(cpu, bus, &cpu->registers.l);
@@ -542,11 +617,10 @@ void cpu_execute(cpu_t *cpu, bus_t *bus, u8 opcode)
 		break;
 	case 0x2F: /* cpl */
 		cpu->registers.a = ~cpu->registers.a;
-		cpu->registers.flag_n = true;
-		cpu->registers.flag_h = true;
+		cpu_flags(cpu, cpu_flag_z(cpu), true, true, cpu_flag_c(cpu));
 		break;
 	case 0x30: /* jr nc, r8 */
-		if (!cpu->registers.flag_c)
+		if (!cpu_flag_c(cpu))
 		{
 			cpu->registers.pc += (i8)imm8;
 			cpu->clock.cycles += 4;
@@ -562,29 +636,23 @@ void cpu_execute(cpu_t *cpu, bus_t *bus, u8 opcode)
 		cpu->registers.sp++;
 		break;
 	case 0x34: /* inc (hl) */
-		tmp8 = bus_peek8(bus, cpu->registers.hl) + 1;
+		tmp8 = bus_peek8(bus, cpu->registers.hl);
+		cpu_inc(cpu, bus, &tmp8);
 		bus_poke8(bus, cpu->registers.hl, tmp8);
-		cpu->registers.flag_z = IS_ZERO(tmp8);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = (tmp8 & 0xF) < ((tmp8 - 1) & 0xF);
 		break;
 	case 0x35: /* dec (hl) */
-		tmp8 = bus_peek8(bus, cpu->registers.hl) - 1;
+		tmp8 = bus_peek8(bus, cpu->registers.hl);
+		cpu_dec(cpu, bus, &tmp8);
 		bus_poke8(bus, cpu->registers.hl, tmp8);
-		cpu->registers.flag_z = IS_ZERO(tmp8);
-		cpu->registers.flag_n = true;
-		cpu->registers.flag_h = (tmp8 & 0xF) == 0xF;
 		break;
 	case 0x36: /* ld (hl), d8 */
 		bus_poke8(bus, cpu->registers.hl, imm8);
 		break;
 	case 0x37: /* scf */
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = false;
-		cpu->registers.flag_c = true;
+		cpu_flags(cpu, cpu_flag_z(cpu), false, false, true);
 		break;
 	case 0x38: /* jr c, r8 */
-		if (cpu->registers.flag_c)
+		if (cpu_flag_c(cpu))
 		{
 			cpu->registers.pc += (i8)imm8;
 			cpu->clock.cycles += 4;
@@ -600,10 +668,7 @@ void cpu_execute(cpu_t *cpu, bus_t *bus, u8 opcode)
 		cpu->registers.sp--;
 		break;
 	case 0x3C: /* inc a */
-		cpu->registers.a++;
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.a);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = (cpu->registers.a & 0xF) < ((cpu->registers.a - 1) & 0xF);
+		cpu_inc(cpu, bus, &cpu->registers.a);
 		break;
 	case 0x3D: /* dec a */
 		cpu_dec(cpu, bus, &cpu->registers.a);
@@ -612,9 +677,7 @@ void cpu_execute(cpu_t *cpu, bus_t *bus, u8 opcode)
 		cpu->registers.a = imm8;
 		break;
 	case 0x3F: /* ccf */
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = false;
-		cpu->registers.flag_c = !cpu->registers.flag_c;
+		cpu_flags(cpu, cpu_flag_z(cpu), false, false, !cpu_flag_c(cpu));
 		break;
 	case 0x40: /* ld b, b */
 		cpu->registers.b = cpu->registers.b;
@@ -905,224 +968,103 @@ void cpu_execute(cpu_t *cpu, bus_t *bus, u8 opcode)
 		cpu_sbc(cpu, bus, cpu->registers.a);
 		break;
 	case 0xA0: /* and b */
-		cpu->registers.a &= cpu->registers.b;
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.a);
-		cpu->registers.flag_n = 0;
-		cpu->registers.flag_h = 1;
-		cpu->registers.flag_c = 0;
+		cpu_and(cpu, bus, cpu->registers.b);
 		break;
 	case 0xA1: /* and c */
-		cpu->registers.a &= cpu->registers.c;
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.a);
-		cpu->registers.flag_n = 0;
-		cpu->registers.flag_h = 1;
-		cpu->registers.flag_c = 0;
+		cpu_and(cpu, bus, cpu->registers.c);
 		break;
 	case 0xA2: /* and d */
-		cpu->registers.a &= cpu->registers.d;
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.a);
-		cpu->registers.flag_n = 0;
-		cpu->registers.flag_h = 1;
-		cpu->registers.flag_c = 0;
+		cpu_and(cpu, bus, cpu->registers.d);
 		break;
 	case 0xA3: /* and e */
-		cpu->registers.a &= cpu->registers.e;
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.a);
-		cpu->registers.flag_n = 0;
-		cpu->registers.flag_h = 1;
-		cpu->registers.flag_c = 0;
+		cpu_and(cpu, bus, cpu->registers.e);
 		break;
 	case 0xA4: /* and h */
-		cpu->registers.a &= cpu->registers.h;
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.a);
-		cpu->registers.flag_n = 0;
-		cpu->registers.flag_h = 1;
-		cpu->registers.flag_c = 0;
+		cpu_and(cpu, bus, cpu->registers.h);
 		break;
 	case 0xA5: /* and l */
-		cpu->registers.a &= cpu->registers.l;
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.a);
-		cpu->registers.flag_n = 0;
-		cpu->registers.flag_h = 1;
-		cpu->registers.flag_c = 0;
+		cpu_and(cpu, bus, cpu->registers.l);
 		break;
 	case 0xA6: /* and (hl) */
-		cpu->registers.a &= bus_peek8(bus, cpu->registers.hl);
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.a);
-		cpu->registers.flag_n = 0;
-		cpu->registers.flag_h = 1;
-		cpu->registers.flag_c = 0;
+		cpu_and(cpu, bus, bus_peek8(bus, cpu->registers.hl));
 		break;
 	case 0xA7: /* and a */
-		cpu->registers.a &= cpu->registers.a;
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.a);
-		cpu->registers.flag_n = 0;
-		cpu->registers.flag_h = 1;
-		cpu->registers.flag_c = 0;
+		cpu_and(cpu, bus, cpu->registers.a);
 		break;
 	case 0xA8: /* xor b */
-		cpu->registers.a ^= cpu->registers.b;
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.a);
-		cpu->registers.flag_n = 0;
-		cpu->registers.flag_h = 0;
-		cpu->registers.flag_c = 0;
+		cpu_xor(cpu, bus, cpu->registers.b);
 		break;
 	case 0xA9: /* xor c */
-		cpu->registers.a ^= cpu->registers.c;
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.a);
-		cpu->registers.flag_n = 0;
-		cpu->registers.flag_h = 0;
-		cpu->registers.flag_c = 0;
+		cpu_xor(cpu, bus, cpu->registers.c);
 		break;
 	case 0xAA: /* xor d */
-		cpu->registers.a ^= cpu->registers.d;
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.a);
-		cpu->registers.flag_n = 0;
-		cpu->registers.flag_h = 0;
-		cpu->registers.flag_c = 0;
+		cpu_xor(cpu, bus, cpu->registers.d);
 		break;
 	case 0xAB: /* xor e */
-		cpu->registers.a ^= cpu->registers.e;
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.a);
-		cpu->registers.flag_n = 0;
-		cpu->registers.flag_h = 0;
-		cpu->registers.flag_c = 0;
+		cpu_xor(cpu, bus, cpu->registers.e);
 		break;
 	case 0xAC: /* xor h */
-		cpu->registers.a ^= cpu->registers.h;
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.a);
-		cpu->registers.flag_n = 0;
-		cpu->registers.flag_h = 0;
-		cpu->registers.flag_c = 0;
+		cpu_xor(cpu, bus, cpu->registers.h);
 		break;
 	case 0xAD: /* xor l */
-		cpu->registers.a ^= cpu->registers.l;
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.a);
-		cpu->registers.flag_n = 0;
-		cpu->registers.flag_h = 0;
-		cpu->registers.flag_c = 0;
+		cpu_xor(cpu, bus, cpu->registers.l);
 		break;
 	case 0xAE: /* xor (hl) */
-		cpu->registers.a ^= bus_peek8(bus, cpu->registers.hl);
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.a);
-		cpu->registers.flag_n = 0;
-		cpu->registers.flag_h = 0;
-		cpu->registers.flag_c = 0;
+		cpu_xor(cpu, bus, bus_peek8(bus, cpu->registers.hl));
 		break;
 	case 0xAF: /* xor a */
-		cpu->registers.a ^= cpu->registers.a;
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.a);
-		cpu->registers.flag_n = 0;
-		cpu->registers.flag_h = 0;
-		cpu->registers.flag_c = 0;
+		cpu_xor(cpu, bus, cpu->registers.a);
 		break;
 	case 0xB0: /* or b */
-		cpu->registers.a |= cpu->registers.b;
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.a);
-		cpu->registers.flag_n = 0;
-		cpu->registers.flag_h = 0;
-		cpu->registers.flag_c = 0;
+		cpu_or(cpu, bus, cpu->registers.b);
 		break;
 	case 0xB1: /* or c */
-		cpu->registers.a |= cpu->registers.c;
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.a);
-		cpu->registers.flag_n = 0;
-		cpu->registers.flag_h = 0;
-		cpu->registers.flag_c = 0;
+		cpu_or(cpu, bus, cpu->registers.c);
 		break;
 	case 0xB2: /* or d */
-		cpu->registers.a |= cpu->registers.d;
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.a);
-		cpu->registers.flag_n = 0;
-		cpu->registers.flag_h = 0;
-		cpu->registers.flag_c = 0;
+		cpu_or(cpu, bus, cpu->registers.d);
 		break;
 	case 0xB3: /* or e */
-		cpu->registers.a |= cpu->registers.e;
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.a);
-		cpu->registers.flag_n = 0;
-		cpu->registers.flag_h = 0;
-		cpu->registers.flag_c = 0;
+		cpu_or(cpu, bus, cpu->registers.e);
 		break;
 	case 0xB4: /* or h */
-		cpu->registers.a |= cpu->registers.h;
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.a);
-		cpu->registers.flag_n = 0;
-		cpu->registers.flag_h = 0;
-		cpu->registers.flag_c = 0;
+		cpu_or(cpu, bus, cpu->registers.h);
 		break;
 	case 0xB5: /* or l */
-		cpu->registers.a |= cpu->registers.l;
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.a);
-		cpu->registers.flag_n = 0;
-		cpu->registers.flag_h = 0;
-		cpu->registers.flag_c = 0;
+		cpu_or(cpu, bus, cpu->registers.l);
 		break;
 	case 0xB6: /* or (hl) */
-		cpu->registers.a |= bus_peek8(bus, cpu->registers.hl);
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.a);
-		cpu->registers.flag_n = 0;
-		cpu->registers.flag_h = 0;
-		cpu->registers.flag_c = 0;
+		cpu_or(cpu, bus, bus_peek8(bus, cpu->registers.hl));
 		break;
 	case 0xB7: /* or a */
-		cpu->registers.a |= cpu->registers.a;
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.a);
-		cpu->registers.flag_n = 0;
-		cpu->registers.flag_h = 0;
-		cpu->registers.flag_c = 0;
+		cpu_or(cpu, bus, cpu->registers.a);
 		break;
 	case 0xB8: /* cp b */
-		cpu->registers.flag_z = cpu->registers.a == cpu->registers.b;
-		cpu->registers.flag_n = 1;
-		cpu->registers.flag_h = (cpu->registers.a & 0xF) < (cpu->registers.b & 0xF);
-		cpu->registers.flag_c = cpu->registers.a < cpu->registers.b;
+		cpu_cp(cpu, bus, cpu->registers.b);
 		break;
 	case 0xB9: /* cp c */
-		cpu->registers.flag_z = cpu->registers.a == cpu->registers.c;
-		cpu->registers.flag_n = 1;
-		cpu->registers.flag_h = (cpu->registers.a & 0xF) < (cpu->registers.c & 0xF);
-		cpu->registers.flag_c = cpu->registers.a < cpu->registers.c;
+		cpu_cp(cpu, bus, cpu->registers.c);
 		break;
 	case 0xBA: /* cp d */
-		cpu->registers.flag_z = cpu->registers.a == cpu->registers.d;
-		cpu->registers.flag_n = 1;
-		cpu->registers.flag_h = (cpu->registers.a & 0xF) < (cpu->registers.d & 0xF);
-		cpu->registers.flag_c = cpu->registers.a < cpu->registers.d;
+		cpu_cp(cpu, bus, cpu->registers.d);
 		break;
 	case 0xBB: /* cp e */
-		cpu->registers.flag_z = cpu->registers.a == cpu->registers.e;
-		cpu->registers.flag_n = 1;
-		cpu->registers.flag_h = (cpu->registers.a & 0xF) < (cpu->registers.e & 0xF);
-		cpu->registers.flag_c = cpu->registers.a < cpu->registers.e;
+		cpu_cp(cpu, bus, cpu->registers.e);
 		break;
 	case 0xBC: /* cp h */
-		cpu->registers.flag_z = cpu->registers.a == cpu->registers.h;
-		cpu->registers.flag_n = 1;
-		cpu->registers.flag_h = (cpu->registers.a & 0xF) < (cpu->registers.h & 0xF);
-		cpu->registers.flag_c = cpu->registers.a < cpu->registers.h;
+		cpu_cp(cpu, bus, cpu->registers.h);
 		break;
 	case 0xBD: /* cp l */
-		cpu->registers.flag_z = cpu->registers.a == cpu->registers.l;
-		cpu->registers.flag_n = 1;
-		cpu->registers.flag_h = (cpu->registers.a & 0xF) < (cpu->registers.l & 0xF);
-		cpu->registers.flag_c = cpu->registers.a < cpu->registers.l;
+		cpu_cp(cpu, bus, cpu->registers.l);
 		break;
 	case 0xBE: /* cp (hl) */
-		tmp8 = bus_peek8(bus, cpu->registers.hl);
-		cpu->registers.flag_z = cpu->registers.a == tmp8;
-		cpu->registers.flag_n = 1;
-		cpu->registers.flag_h = (cpu->registers.a & 0xF) < (tmp8 & 0xF);
-		cpu->registers.flag_c = cpu->registers.a < tmp8;
+		cpu_cp(cpu, bus, bus_peek8(bus, cpu->registers.hl));
 		break;
 	case 0xBF: /* cp a */
-		cpu->registers.flag_z = true;
-		cpu->registers.flag_n = true;
-		cpu->registers.flag_h = false;
-		cpu->registers.flag_c = false;
+		cpu_cp(cpu, bus, cpu->registers.a);
 		break;
 	case 0xC0: /* ret nz */
-		if (!cpu->registers.flag_z)
+		if (!cpu_flag_z(cpu))
 		{
 			cpu_ret(cpu, bus);
 			cpu->clock.cycles += 12;
@@ -1132,7 +1074,7 @@ void cpu_execute(cpu_t *cpu, bus_t *bus, u8 opcode)
 		cpu->registers.bc = cpu_pop(cpu, bus);
 		break;
 	case 0xC2: /* jp nz, a16 */
-		if (!cpu->registers.flag_z)
+		if (!cpu_flag_z(cpu))
 		{
 			cpu->registers.pc = imm16;
 			cpu->clock.cycles += 4;
@@ -1142,7 +1084,7 @@ void cpu_execute(cpu_t *cpu, bus_t *bus, u8 opcode)
 		cpu->registers.pc = imm16;
 		break;
 	case 0xC4: /* call nz, a16 */
-		if (!cpu->registers.flag_z)
+		if (!cpu_flag_z(cpu))
 		{
 			cpu_call(cpu, bus, imm16);
 			cpu->clock.cycles += 12;
@@ -1152,18 +1094,13 @@ void cpu_execute(cpu_t *cpu, bus_t *bus, u8 opcode)
 		cpu_push(cpu, bus, cpu->registers.bc);
 		break;
 	case 0xC6: /* add a, d8 */
-		tmp8 = cpu->registers.a + imm8;
-		cpu->registers.flag_z = IS_ZERO(tmp8);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = (tmp8 & 0xF) < (cpu->registers.a & 0xF);
-		cpu->registers.flag_c = (tmp8 & 0xFF) < (cpu->registers.a & 0xFF);
-		cpu->registers.a = tmp8;
+		cpu_add(cpu, bus, imm8);
 		break;
 	case 0xC7: /* rst 00h */
 		cpu_call(cpu, bus, 0x00);
 		break;
 	case 0xC8: /* ret z */
-		if (cpu->registers.flag_z)
+		if (cpu_flag_z(cpu))
 		{
 			cpu_ret(cpu, bus);
 			cpu->clock.cycles += 12;
@@ -1173,7 +1110,7 @@ void cpu_execute(cpu_t *cpu, bus_t *bus, u8 opcode)
 		cpu_ret(cpu, bus);
 		break;
 	case 0xCA: /* jp z, a16 */
-		if (cpu->registers.flag_z)
+		if (cpu_flag_z(cpu))
 		{
 			cpu->registers.pc = imm16;
 			cpu->clock.cycles += 4;
@@ -1183,7 +1120,7 @@ void cpu_execute(cpu_t *cpu, bus_t *bus, u8 opcode)
 		cpu_execute_cb(cpu, bus, imm8);
 		break;
 	case 0xCC: /* call z, a16 */
-		if (cpu->registers.flag_z)
+		if (cpu_flag_z(cpu))
 		{
 			cpu_call(cpu, bus, imm16);
 			cpu->clock.cycles += 12;
@@ -1199,7 +1136,7 @@ void cpu_execute(cpu_t *cpu, bus_t *bus, u8 opcode)
 		cpu_call(cpu, bus, 0x08);
 		break;
 	case 0xD0: /* ret nc */
-		if (!cpu->registers.flag_c)
+		if (!cpu_flag_c(cpu))
 		{
 			cpu_ret(cpu, bus);
 			cpu->clock.cycles += 12;
@@ -1209,14 +1146,14 @@ void cpu_execute(cpu_t *cpu, bus_t *bus, u8 opcode)
 		cpu->registers.de = cpu_pop(cpu, bus);
 		break;
 	case 0xD2: /* jp nc, a16 */
-		if (!cpu->registers.flag_c)
+		if (!cpu_flag_c(cpu))
 		{
 			cpu->registers.pc = imm16;
 			cpu->clock.cycles += 4;
 		}
 		break;
 	case 0xD4: /* call nc, a16 */
-		if (!cpu->registers.flag_c)
+		if (!cpu_flag_c(cpu))
 		{
 			cpu_call(cpu, bus, imm16);
 			cpu->clock.cycles += 12;
@@ -1226,18 +1163,13 @@ void cpu_execute(cpu_t *cpu, bus_t *bus, u8 opcode)
 		cpu_push(cpu, bus, cpu->registers.de);
 		break;
 	case 0xD6: /* sub d8 */
-		tmp8 = cpu->registers.a - imm8;
-		cpu->registers.flag_z = IS_ZERO(tmp8);
-		cpu->registers.flag_n = true;
-		cpu->registers.flag_h = (tmp8 & 0xF) > (cpu->registers.a & 0xF);
-		cpu->registers.flag_c = (tmp8 & 0xFF) > (cpu->registers.a & 0xFF);
-		cpu->registers.a = tmp8;
+		cpu_sub(cpu, bus, imm8);
 		break;
 	case 0xD7: /* rst 10h */
 		cpu_call(cpu, bus, 0x10);
 		break;
 	case 0xD8: /* ret c */
-		if (cpu->registers.flag_c)
+		if (cpu_flag_c(cpu))
 		{
 			cpu_ret(cpu, bus);
 			cpu->clock.cycles += 12;
@@ -1249,14 +1181,14 @@ void cpu_execute(cpu_t *cpu, bus_t *bus, u8 opcode)
 		cpu->interrupt.pending = 1;
 		break;
 	case 0xDA: /* jp c, a16 */
-		if (cpu->registers.flag_c)
+		if (cpu_flag_c(cpu))
 		{
 			cpu->registers.pc = imm16;
 			cpu->clock.cycles += 4;
 		}
 		break;
 	case 0xDC: /* call c, a16 */
-		if (cpu->registers.flag_c)
+		if (cpu_flag_c(cpu))
 		{
 			cpu_call(cpu, bus, imm16);
 			cpu->clock.cycles += 12;
@@ -1281,11 +1213,7 @@ void cpu_execute(cpu_t *cpu, bus_t *bus, u8 opcode)
 		cpu_push(cpu, bus, cpu->registers.hl);
 		break;
 	case 0xE6: /* and d8 */
-		cpu->registers.a &= imm8;
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.a);
-		cpu->registers.flag_n = 0;
-		cpu->registers.flag_h = 1;
-		cpu->registers.flag_c = 0;
+		cpu_and(cpu, bus, imm8);
 		break;
 	case 0xE7: /* rst 20h */
 		cpu_call(cpu, bus, 0x20);
@@ -1300,11 +1228,7 @@ void cpu_execute(cpu_t *cpu, bus_t *bus, u8 opcode)
 		bus_poke8(bus, imm16, cpu->registers.a);
 		break;
 	case 0xEE: /* xor d8 */
-		cpu->registers.a ^= imm8;
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.a);
-		cpu->registers.flag_n = 0;
-		cpu->registers.flag_h = 0;
-		cpu->registers.flag_c = 0;
+		cpu_xor(cpu, bus, imm8);
 		break;
 	case 0xEF: /* rst 28h */
 		cpu_call(cpu, bus, 0x28);
@@ -1313,7 +1237,9 @@ void cpu_execute(cpu_t *cpu, bus_t *bus, u8 opcode)
 		cpu->registers.a = bus_peek8(bus, 0xFF00 + imm8);
 		break;
 	case 0xF1: /* pop af */
-		cpu->registers.af = cpu_pop(cpu, bus) & 0xFFF0;
+		tmp16 = cpu_pop(cpu, bus);
+		cpu->registers.a = tmp16 >> 8;
+		cpu_flags_set(cpu, (u8)tmp16);
 		break;
 	case 0xF2: /* ld a, (c) */
 		cpu->registers.a = bus_peek8(bus, 0xFF00 + cpu->registers.c);
@@ -1322,14 +1248,10 @@ void cpu_execute(cpu_t *cpu, bus_t *bus, u8 opcode)
 		cpu->interrupt.master = false;
 		break;
 	case 0xF5: /* push af */
-		cpu_push(cpu, bus, cpu->registers.af);
+		cpu_push(cpu, bus, cpu->registers.a << 8 | cpu_flags_get(cpu));
 		break;
 	case 0xF6: /* or d8 */
-		cpu->registers.a |= imm8;
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.a);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = false;
-		cpu->registers.flag_c = false;
+		cpu_or(cpu, bus, imm8);
 		break;
 	case 0xF7: /* rst 30h */
 		cpu_call(cpu, bus, 0x30);
@@ -1353,10 +1275,7 @@ void cpu_execute(cpu_t *cpu, bus_t *bus, u8 opcode)
 		cpu->interrupt.pending = 1;
 		break;
 	case 0xFE: /* cp d8 */
-		cpu->registers.flag_z = cpu->registers.a == imm8;
-		cpu->registers.flag_n = 1;
-		cpu->registers.flag_h = (cpu->registers.a & 0xF) < (imm8 & 0xF);
-		cpu->registers.flag_c = cpu->registers.a < imm8;
+		cpu_cp(cpu, bus, imm8);
 		break;
 	case 0xFF: /* rst 38h */
 		cpu_call(cpu, bus, 0x38);
@@ -1369,798 +1288,403 @@ void cpu_execute(cpu_t *cpu, bus_t *bus, u8 opcode)
 
 void cpu_execute_cb(cpu_t *cpu, bus_t *bus, u8 opcode)
 {
-	/* decode opcode & immediate values */
+	/* decode the prefixed opcode, its length & cycles are on top of the prefix's */
 	opc_t *opc = &opc_opcodes_cb[opcode];
-
-	/* update state */
-	cpu->registers.pc += opc->length - 1; // subtract one because length of prefix is already counted
+	cpu->registers.pc += opc->length - 1;
 	cpu->clock.cycles += opc->cycles;
 
 	/* temporary values */
 	u8 tmp8;
-	u16 tmp16;
 
 	switch (opcode)
 	{
 	case 0x00: /* rlc b */
-		tmp8 = cpu->registers.b >> 7;
-		cpu->registers.b = (cpu->registers.b << 1) | tmp8;
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.b);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = false;
-		cpu->registers.flag_c = tmp8;
+		cpu_rlc(cpu, bus, &cpu->registers.b);
 		break;
 	case 0x01: /* rlc c */
-		tmp8 = cpu->registers.c >> 7;
-		cpu->registers.c = (cpu->registers.c << 1) | tmp8;
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.c);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = false;
-		cpu->registers.flag_c = tmp8;
+		cpu_rlc(cpu, bus, &cpu->registers.c);
 		break;
 	case 0x02: /* rlc d */
-		tmp8 = cpu->registers.d >> 7;
-		cpu->registers.d = (cpu->registers.d << 1) | tmp8;
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.d);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = false;
-		cpu->registers.flag_c = tmp8;
+		cpu_rlc(cpu, bus, &cpu->registers.d);
 		break;
 	case 0x03: /* rlc e */
-		tmp8 = cpu->registers.e >> 7;
-		cpu->registers.e = (cpu->registers.e << 1) | tmp8;
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.e);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = false;
-		cpu->registers.flag_c = tmp8;
+		cpu_rlc(cpu, bus, &cpu->registers.e);
 		break;
 	case 0x04: /* rlc h */
-		tmp8 = cpu->registers.h >> 7;
-		cpu->registers.h = (cpu->registers.h << 1) | tmp8;
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.h);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = false;
-		cpu->registers.flag_c = tmp8;
+		cpu_rlc(cpu, bus, &cpu->registers.h);
 		break;
 	case 0x05: /* rlc l */
-		tmp8 = cpu->registers.l >> 7;
-		cpu->registers.l = (cpu->registers.l << 1) | tmp8;
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.l);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = false;
-		cpu->registers.flag_c = tmp8;
+		cpu_rlc(cpu, bus, &cpu->registers.l);
 		break;
 	case 0x06: /* rlc (hl) */
-		tmp8 = bus_peek8(bus, cpu->registers.hl) >> 7;
-		bus_poke8(bus, cpu->registers.hl, (bus_peek8(bus, cpu->registers.hl) << 1) | tmp8);
-		cpu->registers.flag_z = IS_ZERO(bus_peek8(bus, cpu->registers.hl));
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = false;
-		cpu->registers.flag_c = tmp8;
+		tmp8 = bus_peek8(bus, cpu->registers.hl);
+		cpu_rlc(cpu, bus, &tmp8);
+		bus_poke8(bus, cpu->registers.hl, tmp8);
 		break;
 	case 0x07: /* rlc a */
-		tmp8 = cpu->registers.a >> 7;
-		cpu->registers.a = (cpu->registers.a << 1) | tmp8;
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.a);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = false;
-		cpu->registers.flag_c = tmp8;
+		cpu_rlc(cpu, bus, &cpu->registers.a);
 		break;
 	case 0x08: /* rrc b */
-		tmp8 = cpu->registers.b & 0x1;
-		cpu->registers.b = (cpu->registers.b >> 1) | (tmp8 << 7);
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.b);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = false;
-		cpu->registers.flag_c = tmp8;
+		cpu_rrc(cpu, bus, &cpu->registers.b);
 		break;
 	case 0x09: /* rrc c */
-		tmp8 = cpu->registers.c & 0x1;
-		cpu->registers.c = (cpu->registers.c >> 1) | (tmp8 << 7);
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.c);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = false;
-		cpu->registers.flag_c = tmp8;
+		cpu_rrc(cpu, bus, &cpu->registers.c);
 		break;
 	case 0x0A: /* rrc d */
-		tmp8 = cpu->registers.d & 0x1;
-		cpu->registers.d = (cpu->registers.d >> 1) | (tmp8 << 7);
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.d);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = false;
-		cpu->registers.flag_c = tmp8;
+		cpu_rrc(cpu, bus, &cpu->registers.d);
 		break;
 	case 0x0B: /* rrc e */
-		tmp8 = cpu->registers.e & 0x1;
-		cpu->registers.e = (cpu->registers.e >> 1) | (tmp8 << 7);
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.e);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = false;
-		cpu->registers.flag_c = tmp8;
+		cpu_rrc(cpu, bus, &cpu->registers.e);
 		break;
 	case 0x0C: /* rrc h */
-		tmp8 = cpu->registers.h & 0x1;
-		cpu->registers.h = (cpu->registers.h >> 1) | (tmp8 << 7);
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.h);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = false;
-		cpu->registers.flag_c = tmp8;
+		cpu_rrc(cpu, bus, &cpu->registers.h);
 		break;
 	case 0x0D: /* rrc l */
-		tmp8 = cpu->registers.l & 0x1;
-		cpu->registers.l = (cpu->registers.l >> 1) | (tmp8 << 7);
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.l);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = false;
-		cpu->registers.flag_c = tmp8;
+		cpu_rrc(cpu, bus, &cpu->registers.l);
 		break;
 	case 0x0E: /* rrc (hl) */
-		tmp8 = bus_peek8(bus, cpu->registers.hl) & 0x1;
-		tmp16 = (bus_peek8(bus, cpu->registers.hl) >> 1) | (tmp8 ? 0x80 : 0);
-		bus_poke8(bus, cpu->registers.hl, tmp16);
-		cpu->registers.flag_z = IS_ZERO(tmp16);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = false;
-		cpu->registers.flag_c = tmp8;
+		tmp8 = bus_peek8(bus, cpu->registers.hl);
+		cpu_rrc(cpu, bus, &tmp8);
+		bus_poke8(bus, cpu->registers.hl, tmp8);
 		break;
 	case 0x0F: /* rrc a */
-		tmp8 = cpu->registers.a & 0x1;
-		cpu->registers.a = (cpu->registers.a >> 1) | (tmp8 << 7);
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.a);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = false;
-		cpu->registers.flag_c = tmp8;
+		cpu_rrc(cpu, bus, &cpu->registers.a);
 		break;
 	case 0x10: /* rl b */
-		tmp8 = cpu->registers.b;
-		cpu->registers.b = (cpu->registers.b << 1) | cpu->registers.flag_c;
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.b);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = false;
-		cpu->registers.flag_c = tmp8 >> 7;
+		cpu->registers.b = cpu_rl(cpu, bus, cpu->registers.b);
 		break;
 	case 0x11: /* rl c */
-		tmp8 = cpu->registers.c;
-		cpu->registers.c = (cpu->registers.c << 1) | cpu->registers.flag_c;
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.c);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = false;
-		cpu->registers.flag_c = tmp8 >> 7;
+		cpu->registers.c = cpu_rl(cpu, bus, cpu->registers.c);
 		break;
 	case 0x12: /* rl d */
-		tmp8 = cpu->registers.d;
-		cpu->registers.d = (cpu->registers.d << 1) | cpu->registers.flag_c;
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.d);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = false;
-		cpu->registers.flag_c = tmp8 >> 7;
+		cpu->registers.d = cpu_rl(cpu, bus, cpu->registers.d);
 		break;
 	case 0x13: /* rl e */
-		tmp8 = cpu->registers.e;
-		cpu->registers.e = (cpu->registers.e << 1) | cpu->registers.flag_c;
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.e);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = false;
-		cpu->registers.flag_c = tmp8 >> 7;
+		cpu->registers.e = cpu_rl(cpu, bus, cpu->registers.e);
 		break;
 	case 0x14: /* rl h */
-		tmp8 = cpu->registers.h;
-		cpu->registers.h = (cpu->registers.h << 1) | cpu->registers.flag_c;
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.h);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = false;
-		cpu->registers.flag_c = tmp8 >> 7;
+		cpu->registers.h = cpu_rl(cpu, bus, cpu->registers.h);
 		break;
 	case 0x15: /* rl l */
-		tmp8 = cpu->registers.l;
-		cpu->registers.l = (cpu->registers.l << 1) | cpu->registers.flag_c;
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.l);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = false;
-		cpu->registers.flag_c = tmp8 >> 7;
+		cpu->registers.l = cpu_rl(cpu, bus, cpu->registers.l);
 		break;
 	case 0x16: /* rl (hl) */
 		bus_poke8(bus, cpu->registers.hl, cpu_rl(cpu, bus, bus_peek8(bus, cpu->registers.hl)));
 		break;
 	case 0x17: /* rl a */
-		tmp8 = cpu->registers.a;
-		cpu->registers.a = (cpu->registers.a << 1) | cpu->registers.flag_c;
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.a);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = false;
-		cpu->registers.flag_c = tmp8 >> 7;
+		cpu->registers.a = cpu_rl(cpu, bus, cpu->registers.a);
 		break;
 	case 0x18: /* rr b */
-		tmp8 = cpu->registers.b & 0x1;
-		cpu->registers.b = (cpu->registers.b >> 1) | (cpu->registers.flag_c << 7);
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.b);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = false;
-		cpu->registers.flag_c = tmp8;
+		cpu->registers.b = cpu_rr(cpu, bus, cpu->registers.b);
 		break;
 	case 0x19: /* rr c */
-		tmp8 = cpu->registers.c & 0x1;
-		cpu->registers.c = (cpu->registers.c >> 1) | (cpu->registers.flag_c << 7);
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.c);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = false;
-		cpu->registers.flag_c = tmp8;
+		cpu->registers.c = cpu_rr(cpu, bus, cpu->registers.c);
 		break;
 	case 0x1A: /* rr d */
-		tmp8 = cpu->registers.d & 0x1;
-		cpu->registers.d = (cpu->registers.d >> 1) | (cpu->registers.flag_c << 7);
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.d);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = false;
-		cpu->registers.flag_c = tmp8;
+		cpu->registers.d = cpu_rr(cpu, bus, cpu->registers.d);
 		break;
 	case 0x1B: /* rr e */
-		tmp8 = cpu->registers.e & 0x1;
-		cpu->registers.e = (cpu->registers.e >> 1) | (cpu->registers.flag_c << 7);
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.e);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = false;
-		cpu->registers.flag_c = tmp8;
+		cpu->registers.e = cpu_rr(cpu, bus, cpu->registers.e);
 		break;
 	case 0x1C: /* rr h */
-		tmp8 = cpu->registers.h & 0x1;
-		cpu->registers.h = (cpu->registers.h >> 1) | (cpu->registers.flag_c << 7);
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.h);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = false;
-		cpu->registers.flag_c = tmp8;
+		cpu->registers.h = cpu_rr(cpu, bus, cpu->registers.h);
 		break;
 	case 0x1D: /* rr l */
-		tmp8 = cpu->registers.l & 0x1;
-		cpu->registers.l = (cpu->registers.l >> 1) | (cpu->registers.flag_c << 7);
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.l);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = false;
-		cpu->registers.flag_c = tmp8;
+		cpu->registers.l = cpu_rr(cpu, bus, cpu->registers.l);
 		break;
 	case 0x1E: /* rr (hl) */
 		bus_poke8(bus, cpu->registers.hl, cpu_rr(cpu, bus, bus_peek8(bus, cpu->registers.hl)));
 		break;
 	case 0x1F: /* rr a */
-		tmp8 = cpu->registers.a & 0x1;
-		cpu->registers.a = (cpu->registers.a >> 1) | (cpu->registers.flag_c << 7);
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.a);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = false;
-		cpu->registers.flag_c = tmp8;
+		cpu->registers.a = cpu_rr(cpu, bus, cpu->registers.a);
 		break;
 	case 0x20: /* sla b */
-		cpu->registers.flag_c = cpu->registers.b >> 7;
-		cpu->registers.b = cpu->registers.b << 1;
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.b);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = false;
+		cpu->registers.b = cpu_sla(cpu, bus, cpu->registers.b);
 		break;
 	case 0x21: /* sla c */
-		cpu->registers.flag_c = cpu->registers.c >> 7;
-		cpu->registers.c = cpu->registers.c << 1;
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.c);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = false;
+		cpu->registers.c = cpu_sla(cpu, bus, cpu->registers.c);
 		break;
 	case 0x22: /* sla d */
-		cpu->registers.flag_c = cpu->registers.d >> 7;
-		cpu->registers.d = cpu->registers.d << 1;
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.d);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = false;
+		cpu->registers.d = cpu_sla(cpu, bus, cpu->registers.d);
 		break;
 	case 0x23: /* sla e */
-		cpu->registers.flag_c = cpu->registers.e >> 7;
-		cpu->registers.e = cpu->registers.e << 1;
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.e);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = false;
+		cpu->registers.e = cpu_sla(cpu, bus, cpu->registers.e);
 		break;
 	case 0x24: /* sla h */
-		cpu->registers.flag_c = cpu->registers.h >> 7;
-		cpu->registers.h = cpu->registers.h << 1;
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.h);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = false;
+		cpu->registers.h = cpu_sla(cpu, bus, cpu->registers.h);
 		break;
 	case 0x25: /* sla l */
-		cpu->registers.flag_c = cpu->registers.l >> 7;
-		cpu->registers.l = cpu->registers.l << 1;
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.l);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = false;
+		cpu->registers.l = cpu_sla(cpu, bus, cpu->registers.l);
 		break;
 	case 0x26: /* sla (hl) */
 		bus_poke8(bus, cpu->registers.hl, cpu_sla(cpu, bus, bus_peek8(bus, cpu->registers.hl)));
 		break;
 	case 0x27: /* sla a */
-		cpu->registers.flag_c = cpu->registers.a >> 7;
-		cpu->registers.a = cpu->registers.a << 1;
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.a);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = false;
+		cpu->registers.a = cpu_sla(cpu, bus, cpu->registers.a);
 		break;
 	case 0x28: /* sra b */
-		cpu->registers.flag_c = cpu->registers.b & 0x1;
-		cpu->registers.b = (cpu->registers.b >> 1) | (cpu->registers.b & 0x80);
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.b);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = false;
+		cpu->registers.b = cpu_sra(cpu, bus, cpu->registers.b);
 		break;
 	case 0x29: /* sra c */
-		cpu->registers.flag_c = cpu->registers.c & 0x1;
-		cpu->registers.c = (cpu->registers.c >> 1) | (cpu->registers.c & 0x80);
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.c);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = false;
+		cpu->registers.c = cpu_sra(cpu, bus, cpu->registers.c);
 		break;
 	case 0x2A: /* sra d */
-		cpu->registers.flag_c = cpu->registers.d & 0x1;
-		cpu->registers.d = (cpu->registers.d >> 1) | (cpu->registers.d & 0x80);
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.d);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = false;
+		cpu->registers.d = cpu_sra(cpu, bus, cpu->registers.d);
 		break;
 	case 0x2B: /* sra e */
-		cpu->registers.flag_c = cpu->registers.e & 0x1;
-		cpu->registers.e = (cpu->registers.e >> 1) | (cpu->registers.e & 0x80);
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.e);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = false;
+		cpu->registers.e = cpu_sra(cpu, bus, cpu->registers.e);
 		break;
 	case 0x2C: /* sra h */
-		cpu->registers.flag_c = cpu->registers.h & 0x1;
-		cpu->registers.h = (cpu->registers.h >> 1) | (cpu->registers.h & 0x80);
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.h);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = false;
+		cpu->registers.h = cpu_sra(cpu, bus, cpu->registers.h);
 		break;
 	case 0x2D: /* sra l */
-		cpu->registers.flag_c = cpu->registers.l & 0x1;
-		cpu->registers.l = (cpu->registers.l >> 1) | (cpu->registers.l & 0x80);
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.l);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = false;
+		cpu->registers.l = cpu_sra(cpu, bus, cpu->registers.l);
 		break;
 	case 0x2E: /* sra (hl) */
 		bus_poke8(bus, cpu->registers.hl, cpu_sra(cpu, bus, bus_peek8(bus, cpu->registers.hl)));
 		break;
 	case 0x2F: /* sra a */
-		cpu->registers.flag_c = cpu->registers.a & 0x1;
-		cpu->registers.a = (cpu->registers.a >> 1) | (cpu->registers.a & 0x80);
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.a);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = false;
+		cpu->registers.a = cpu_sra(cpu, bus, cpu->registers.a);
 		break;
 	case 0x30: /* swap b */
-		cpu->registers.b = (cpu->registers.b << 4) | (cpu->registers.b >> 4);
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.b);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = false;
-		cpu->registers.flag_c = false;
+		cpu->registers.b = cpu_swap(cpu, bus, cpu->registers.b);
 		break;
 	case 0x31: /* swap c */
-		cpu->registers.c = (cpu->registers.c << 4) | (cpu->registers.c >> 4);
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.c);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = false;
-		cpu->registers.flag_c = false;
+		cpu->registers.c = cpu_swap(cpu, bus, cpu->registers.c);
 		break;
 	case 0x32: /* swap d */
-		cpu->registers.d = (cpu->registers.d << 4) | (cpu->registers.d >> 4);
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.d);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = false;
-		cpu->registers.flag_c = false;
+		cpu->registers.d = cpu_swap(cpu, bus, cpu->registers.d);
 		break;
 	case 0x33: /* swap e */
-		cpu->registers.e = (cpu->registers.e << 4) | (cpu->registers.e >> 4);
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.e);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = false;
-		cpu->registers.flag_c = false;
+		cpu->registers.e = cpu_swap(cpu, bus, cpu->registers.e);
 		break;
 	case 0x34: /* swap h */
-		cpu->registers.h = (cpu->registers.h << 4) | (cpu->registers.h >> 4);
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.h);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = false;
-		cpu->registers.flag_c = false;
+		cpu->registers.h = cpu_swap(cpu, bus, cpu->registers.h);
 		break;
 	case 0x35: /* swap l */
-		cpu->registers.l = (cpu->registers.l << 4) | (cpu->registers.l >> 4);
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.l);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = false;
-		cpu->registers.flag_c = false;
+		cpu->registers.l = cpu_swap(cpu, bus, cpu->registers.l);
 		break;
 	case 0x36: /* swap (hl) */
-		tmp8 = bus_peek8(bus, cpu->registers.hl);
-		bus_poke8(bus, cpu->registers.hl, (tmp8 << 4) | (tmp8 >> 4));
-		cpu->registers.flag_z = IS_ZERO(tmp8);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = false;
-		cpu->registers.flag_c = false;
+		bus_poke8(bus, cpu->registers.hl, cpu_swap(cpu, bus, bus_peek8(bus, cpu->registers.hl)));
 		break;
 	case 0x37: /* swap a */
-		cpu->registers.a = (cpu->registers.a << 4) | (cpu->registers.a >> 4);
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.a);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = false;
-		cpu->registers.flag_c = false;
+		cpu->registers.a = cpu_swap(cpu, bus, cpu->registers.a);
 		break;
 	case 0x38: /* srl b */
-		cpu->registers.flag_c = cpu->registers.b & 0x1;
-		cpu->registers.b = cpu->registers.b >> 1;
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.b);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = false;
+		cpu->registers.b = cpu_srl(cpu, bus, cpu->registers.b);
 		break;
 	case 0x39: /* srl c */
-		cpu->registers.flag_c = cpu->registers.c & 0x1;
-		cpu->registers.c = cpu->registers.c >> 1;
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.c);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = false;
+		cpu->registers.c = cpu_srl(cpu, bus, cpu->registers.c);
 		break;
 	case 0x3A: /* srl d */
-		cpu->registers.flag_c = cpu->registers.d & 0x1;
-		cpu->registers.d = cpu->registers.d >> 1;
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.d);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = false;
+		cpu->registers.d = cpu_srl(cpu, bus, cpu->registers.d);
 		break;
 	case 0x3B: /* srl e */
-		cpu->registers.flag_c = cpu->registers.e & 0x1;
-		cpu->registers.e = cpu->registers.e >> 1;
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.e);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = false;
+		cpu->registers.e = cpu_srl(cpu, bus, cpu->registers.e);
 		break;
 	case 0x3C: /* srl h */
-		cpu->registers.flag_c = cpu->registers.h & 0x1;
-		cpu->registers.h = cpu->registers.h >> 1;
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.h);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = false;
+		cpu->registers.h = cpu_srl(cpu, bus, cpu->registers.h);
 		break;
 	case 0x3D: /* srl l */
-		cpu->registers.flag_c = cpu->registers.l & 0x1;
-		cpu->registers.l = cpu->registers.l >> 1;
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.l);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = false;
+		cpu->registers.l = cpu_srl(cpu, bus, cpu->registers.l);
 		break;
 	case 0x3E: /* srl (hl) */
 		bus_poke8(bus, cpu->registers.hl, cpu_srl(cpu, bus, bus_peek8(bus, cpu->registers.hl)));
 		break;
 	case 0x3F: /* srl a */
-		cpu->registers.flag_c = cpu->registers.a & 0x1;
-		cpu->registers.a = cpu->registers.a >> 1;
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.a);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = false;
+		cpu->registers.a = cpu_srl(cpu, bus, cpu->registers.a);
 		break;
 	case 0x40: /* bit 0, b */
-		cpu->registers.flag_z = !(cpu->registers.b & 0x01);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = true;
+		cpu_bit(cpu, bus, cpu->registers.b, 0x01);
 		break;
 	case 0x41: /* bit 0, c */
-		cpu->registers.flag_z = !(cpu->registers.c & 0x01);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = true;
+		cpu_bit(cpu, bus, cpu->registers.c, 0x01);
 		break;
 	case 0x42: /* bit 0, d */
-		cpu->registers.flag_z = !(cpu->registers.d & 0x01);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = true;
+		cpu_bit(cpu, bus, cpu->registers.d, 0x01);
 		break;
 	case 0x43: /* bit 0, e */
-		cpu->registers.flag_z = !(cpu->registers.e & 0x01);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = true;
+		cpu_bit(cpu, bus, cpu->registers.e, 0x01);
 		break;
 	case 0x44: /* bit 0, h */
-		cpu->registers.flag_z = !(cpu->registers.h & 0x01);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = true;
+		cpu_bit(cpu, bus, cpu->registers.h, 0x01);
 		break;
 	case 0x45: /* bit 0, l */
-		cpu->registers.flag_z = !(cpu->registers.l & 0x01);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = true;
+		cpu_bit(cpu, bus, cpu->registers.l, 0x01);
 		break;
 	case 0x46: /* bit 0, (hl) */
-		cpu->registers.flag_z = !(bus_peek8(bus, cpu->registers.hl) & 0x01);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = true;
+		cpu_bit(cpu, bus, bus_peek8(bus, cpu->registers.hl), 0x01);
 		break;
 	case 0x47: /* bit 0, a */
-		cpu->registers.flag_z = !(cpu->registers.a & 0x01);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = true;
+		cpu_bit(cpu, bus, cpu->registers.a, 0x01);
 		break;
 	case 0x48: /* bit 1, b */
-		cpu->registers.flag_z = !(cpu->registers.b & 0x02);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = true;
+		cpu_bit(cpu, bus, cpu->registers.b, 0x02);
 		break;
 	case 0x49: /* bit 1, c */
-		cpu->registers.flag_z = !(cpu->registers.c & 0x2);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = true;
+		cpu_bit(cpu, bus, cpu->registers.c, 0x02);
 		break;
 	case 0x4A: /* bit 1, d */
-		cpu->registers.flag_z = !(cpu->registers.d & 0x02);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = true;
+		cpu_bit(cpu, bus, cpu->registers.d, 0x02);
 		break;
 	case 0x4B: /* bit 1, e */
-		cpu->registers.flag_z = !(cpu->registers.e & 0x02);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = true;
+		cpu_bit(cpu, bus, cpu->registers.e, 0x02);
 		break;
 	case 0x4C: /* bit 1, h */
-		cpu->registers.flag_z = !(cpu->registers.h & 0x02);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = true;
+		cpu_bit(cpu, bus, cpu->registers.h, 0x02);
 		break;
 	case 0x4D: /* bit 1, l */
-		cpu->registers.flag_z = !(cpu->registers.l & 0x02);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = true;
+		cpu_bit(cpu, bus, cpu->registers.l, 0x02);
 		break;
 	case 0x4E: /* bit 1, (hl) */
-		cpu->registers.flag_z = !(bus_peek8(bus, cpu->registers.hl) & 0x02);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = true;
+		cpu_bit(cpu, bus, bus_peek8(bus, cpu->registers.hl), 0x02);
 		break;
 	case 0x4F: /* bit 1, a */
-		cpu->registers.flag_z = !(cpu->registers.a & 0x02);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = true;
+		cpu_bit(cpu, bus, cpu->registers.a, 0x02);
 		break;
 	case 0x50: /* bit 2, b */
-		cpu->registers.flag_z = !(cpu->registers.b & 0x04);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = true;
+		cpu_bit(cpu, bus, cpu->registers.b, 0x04);
 		break;
 	case 0x51: /* bit 2, c */
-		cpu->registers.flag_z = !(cpu->registers.c & 0x04);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = true;
+		cpu_bit(cpu, bus, cpu->registers.c, 0x04);
 		break;
 	case 0x52: /* bit 2, d */
-		cpu->registers.flag_z = !(cpu->registers.d & 0x04);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = true;
+		cpu_bit(cpu, bus, cpu->registers.d, 0x04);
 		break;
 	case 0x53: /* bit 2, e */
-		cpu->registers.flag_z = !(cpu->registers.e & 0x04);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = true;
+		cpu_bit(cpu, bus, cpu->registers.e, 0x04);
 		break;
 	case 0x54: /* bit 2, h */
-		cpu->registers.flag_z = !(cpu->registers.h & 0x04);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = true;
+		cpu_bit(cpu, bus, cpu->registers.h, 0x04);
 		break;
 	case 0x55: /* bit 2, l */
-		cpu->registers.flag_z = !(cpu->registers.l & 0x04);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = true;
+		cpu_bit(cpu, bus, cpu->registers.l, 0x04);
 		break;
 	case 0x56: /* bit 2, (hl) */
-		cpu->registers.flag_z = !(bus_peek8(bus, cpu->registers.hl) & 0x04);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = true;
+		cpu_bit(cpu, bus, bus_peek8(bus, cpu->registers.hl), 0x04);
 		break;
 	case 0x57: /* bit 2, a */
-		cpu->registers.flag_z = !(cpu->registers.a & 0x04);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = true;
+		cpu_bit(cpu, bus, cpu->registers.a, 0x04);
 		break;
 	case 0x58: /* bit 3, b */
-		cpu->registers.flag_z = !(cpu->registers.b & 0x08);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = true;
+		cpu_bit(cpu, bus, cpu->registers.b, 0x08);
 		break;
 	case 0x59: /* bit 3, c */
-		cpu->registers.flag_z = !(cpu->registers.c & 0x08);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = true;
+		cpu_bit(cpu, bus, cpu->registers.c, 0x08);
 		break;
 	case 0x5A: /* bit 3, d */
-		cpu->registers.flag_z = !(cpu->registers.d & 0x08);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = true;
+		cpu_bit(cpu, bus, cpu->registers.d, 0x08);
 		break;
 	case 0x5B: /* bit 3, e */
-		cpu->registers.flag_z = !(cpu->registers.e & 0x08);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = true;
+		cpu_bit(cpu, bus, cpu->registers.e, 0x08);
 		break;
 	case 0x5C: /* bit 3, h */
-		cpu->registers.flag_z = !(cpu->registers.h & 0x08);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = true;
+		cpu_bit(cpu, bus, cpu->registers.h, 0x08);
 		break;
 	case 0x5D: /* bit 3, l */
-		cpu->registers.flag_z = !(cpu->registers.l & 0x08);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = true;
+		cpu_bit(cpu, bus, cpu->registers.l, 0x08);
 		break;
 	case 0x5E: /* bit 3, (hl) */
-		cpu->registers.flag_z = !(bus_peek8(bus, cpu->registers.hl) & 0x8);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = true;
+		cpu_bit(cpu, bus, bus_peek8(bus, cpu->registers.hl), 0x08);
 		break;
 	case 0x5F: /* bit 3, a */
-		cpu->registers.flag_z = !(cpu->registers.a & 0x08);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = true;
+		cpu_bit(cpu, bus, cpu->registers.a, 0x08);
 		break;
 	case 0x60: /* bit 4, b */
-		cpu->registers.flag_z = !(cpu->registers.b & 0x10);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = true;
+		cpu_bit(cpu, bus, cpu->registers.b, 0x10);
 		break;
 	case 0x61: /* bit 4, c */
-		cpu->registers.flag_z = !(cpu->registers.c & 0x10);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = true;
+		cpu_bit(cpu, bus, cpu->registers.c, 0x10);
 		break;
 	case 0x62: /* bit 4, d */
-		cpu->registers.flag_z = !(cpu->registers.d & 0x10);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = true;
+		cpu_bit(cpu, bus, cpu->registers.d, 0x10);
 		break;
 	case 0x63: /* bit 4, e */
-		cpu->registers.flag_z = !(cpu->registers.e & 0x10);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = true;
+		cpu_bit(cpu, bus, cpu->registers.e, 0x10);
 		break;
 	case 0x64: /* bit 4, h */
-		cpu->registers.flag_z = !(cpu->registers.h & 0x10);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = true;
+		cpu_bit(cpu, bus, cpu->registers.h, 0x10);
 		break;
 	case 0x65: /* bit 4, l */
-		cpu->registers.flag_z = !(cpu->registers.l & 0x10);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = true;
+		cpu_bit(cpu, bus, cpu->registers.l, 0x10);
 		break;
 	case 0x66: /* bit 4, (hl) */
-		cpu->registers.flag_z = !(bus_peek8(bus, cpu->registers.hl) & 0x10);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = true;
+		cpu_bit(cpu, bus, bus_peek8(bus, cpu->registers.hl), 0x10);
 		break;
 	case 0x67: /* bit 4, a */
-		cpu->registers.flag_z = !(cpu->registers.a & 0x10);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = true;
+		cpu_bit(cpu, bus, cpu->registers.a, 0x10);
 		break;
 	case 0x68: /* bit 5, b */
-		cpu->registers.flag_z = !(cpu->registers.b & 0x20);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = true;
+		cpu_bit(cpu, bus, cpu->registers.b, 0x20);
 		break;
 	case 0x69: /* bit 5, c */
-		cpu->registers.flag_z = !(cpu->registers.c & 0x20);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = true;
+		cpu_bit(cpu, bus, cpu->registers.c, 0x20);
 		break;
 	case 0x6A: /* bit 5, d */
-		cpu->registers.flag_z = !(cpu->registers.d & 0x20);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = true;
+		cpu_bit(cpu, bus, cpu->registers.d, 0x20);
 		break;
 	case 0x6B: /* bit 5, e */
-		cpu->registers.flag_z = !(cpu->registers.e & 0x20);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = true;
+		cpu_bit(cpu, bus, cpu->registers.e, 0x20);
 		break;
 	case 0x6C: /* bit 5, h */
-		cpu->registers.flag_z = !(cpu->registers.h & 0x20);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = true;
+		cpu_bit(cpu, bus, cpu->registers.h, 0x20);
 		break;
 	case 0x6D: /* bit 5, l */
-		cpu->registers.flag_z = !(cpu->registers.l & 0x20);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = true;
+		cpu_bit(cpu, bus, cpu->registers.l, 0x20);
 		break;
 	case 0x6E: /* bit 5, (hl) */
-		cpu->registers.flag_z = !(bus_peek8(bus, cpu->registers.hl) & 0x20);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = true;
+		cpu_bit(cpu, bus, bus_peek8(bus, cpu->registers.hl), 0x20);
 		break;
 	case 0x6F: /* bit 5, a */
-		cpu->registers.flag_z = !(cpu->registers.a & 0x20);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = true;
+		cpu_bit(cpu, bus, cpu->registers.a, 0x20);
 		break;
 	case 0x70: /* bit 6, b */
-		cpu->registers.flag_z = !(cpu->registers.b & 0x40);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = true;
+		cpu_bit(cpu, bus, cpu->registers.b, 0x40);
 		break;
 	case 0x71: /* bit 6, c */
-		cpu->registers.flag_z = !(cpu->registers.c & 0x40);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = true;
+		cpu_bit(cpu, bus, cpu->registers.c, 0x40);
 		break;
 	case 0x72: /* bit 6, d */
-		cpu->registers.flag_z = !(cpu->registers.d & 0x40);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = true;
+		cpu_bit(cpu, bus, cpu->registers.d, 0x40);
 		break;
 	case 0x73: /* bit 6, e */
-		cpu->registers.flag_z = !(cpu->registers.e & 0x40);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = true;
+		cpu_bit(cpu, bus, cpu->registers.e, 0x40);
 		break;
 	case 0x74: /* bit 6, h */
-		cpu->registers.flag_z = !(cpu->registers.h & 0x40);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = true;
+		cpu_bit(cpu, bus, cpu->registers.h, 0x40);
 		break;
 	case 0x75: /* bit 6, l */
-		cpu->registers.flag_z = !(cpu->registers.l & 0x40);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = true;
+		cpu_bit(cpu, bus, cpu->registers.l, 0x40);
 		break;
 	case 0x76: /* bit 6, (hl) */
-		cpu->registers.flag_z = !(bus_peek8(bus, cpu->registers.hl) & 0x40);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = true;
+		cpu_bit(cpu, bus, bus_peek8(bus, cpu->registers.hl), 0x40);
 		break;
 	case 0x77: /* bit 6, a */
-		cpu->registers.flag_z = !(cpu->registers.a & 0x40);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = true;
+		cpu_bit(cpu, bus, cpu->registers.a, 0x40);
 		break;
 	case 0x78: /* bit 7, b */
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.b & 0x80);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = true;
+		cpu_bit(cpu, bus, cpu->registers.b, 0x80);
 		break;
 	case 0x79: /* bit 7, c */
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.c & 0x80);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = true;
+		cpu_bit(cpu, bus, cpu->registers.c, 0x80);
 		break;
 	case 0x7A: /* bit 7, d */
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.d & 0x80);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = true;
+		cpu_bit(cpu, bus, cpu->registers.d, 0x80);
 		break;
 	case 0x7B: /* bit 7, e */
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.e & 0x80);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = true;
+		cpu_bit(cpu, bus, cpu->registers.e, 0x80);
 		break;
 	case 0x7C: /* bit 7, h */
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.h & 0x80);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = true;
+		cpu_bit(cpu, bus, cpu->registers.h, 0x80);
 		break;
 	case 0x7D: /* bit 7, l */
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.l & 0x80);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = true;
+		cpu_bit(cpu, bus, cpu->registers.l, 0x80);
 		break;
 	case 0x7E: /* bit 7, (hl) */
-		cpu->registers.flag_z = IS_ZERO(bus_peek8(bus, cpu->registers.hl) & 0x80);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = true;
+		cpu_bit(cpu, bus, bus_peek8(bus, cpu->registers.hl), 0x80);
 		break;
 	case 0x7F: /* bit 7, a */
-		cpu->registers.flag_z = IS_ZERO(cpu->registers.a & 0x80);
-		cpu->registers.flag_n = false;
-		cpu->registers.flag_h = true;
+		cpu_bit(cpu, bus, cpu->registers.a, 0x80);
 		break;
 	case 0x80: /* res 0, b */
 		cpu->registers.b &= 0xFE;
@@ -2571,20 +2095,48 @@ void cpu_cycle(cpu_t *cpu, bus_t *bus)
 {
 	cpu_cycle_interrupt(cpu, bus);
 
-	/* fetch opcode */
-	u8 opcode = bus_peek8(bus, cpu->registers.pc);
+	/* run from the block cache, which stops early on anything that needs handling between instructions */
+	if (!cpu->halted && !cpu->stopped && !cpu->interrupt.pending && !bus->mmu->hdma.to_copy)
+	{
+		block_t *block = block_lookup(&cpu->cache, bus, cpu->registers.pc);
+
+		if (block)
+		{
+			cpu->clock.timer_read = false;
+
+			if (cpu->backend == CPU_BACKEND_JIT)
+				jit_execute_block(cpu, bus, block);
+			else
+				cpu_execute_block(cpu, bus, block);
+
+			/* a spin loop that came straight back round will keep doing so until the next event */
+			if (block->idle && cpu->registers.pc == block->pc)
+				cpu_skip_idle(cpu, bus);
+			return;
+		}
+	}
 
 	/* execute */
 	if (!cpu->halted && !cpu->stopped)
 	{
-		cpu_execute(cpu, bus, opcode);
+		cpu_execute(cpu, bus, bus_peek8(bus, cpu->registers.pc));
 	}
 	else
 	{
-		//        cpu->clock.cycles += 4;
+		cpu->clock.cycles = cpu_sleep_cycles(cpu, bus);
 	}
+}
+
+u32 cpu_sleep_cycles(cpu_t *cpu, bus_t *bus)
+{
+	sched_t *sched = bus->sched;
+
+	/* a delayed ei counts steps rather than time, & an interrupt that was only just requested wakes the cpu next step */
+	if (cpu->interrupt.pending || (bus->mmu->memory.interrupt_enable & bus->mmu->io.irf) || sched->next <= sched->now)
+		return 4;
 
-	cpu_cycle_clock(cpu, bus, cpu->clock.cycles);
+	/* interrupts are only ever raised by events, so nothing can wake the cpu any sooner */
+	return (u32)(sched->next - sched->now < U32_MAX / 4 ? sched->next - sched->now : U32_MAX / 4) * 4;
 }
 
 void cpu_cycle_interrupt(cpu_t *cpu, bus_t *bus)
@@ -2619,6 +2171,8 @@ void cpu_cycle_interrupt(cpu_t *cpu, bus_t *bus)
 		if (bus->ppu->interrupt.lcd_stat)
 			cpu_request(cpu, bus, INT_LCD_STAT_INDEX);
 	}
+	bus->ppu->interrupt.v_blank = false;
+	bus->ppu->interrupt.lcd_stat = false;
 
 	/* execute interrupts */
 	if (cpu->interrupt.master && !cpu->interrupt.pending)
@@ -2660,101 +2214,70 @@ void cpu_cycle_interrupt(cpu_t *cpu, bus_t *bus)
 	}
 }
 
-void cpu_cycle_clock(cpu_t *cpu, bus_t *bus, usize cycles)
+usize cpu_clock_period(cpu_t *cpu, bus_t *bus, usize cycles)
+{
+	/* the timers run twice as fast relative to the ppu & apu in double speed mode */
+	return bus->mmu->io.current_speed ? cycles / 2 : cycles;
+}
+
+void cpu_sync_timers(cpu_t *cpu, bus_t *bus)
 {
-	usize m_cycles = cycles * (bus->mmu->io.current_speed ? 2 : 1) / 4;
-	cpu->clock.div_clock += m_cycles;
-	cpu->clock.tima_clock += m_cycles;
-	cpu->clock.fs_clock += m_cycles;
+	/* counts the ticks since each timer last went up, both tick at a fixed rate so nothing is lost by waiting */
+	u64 now = bus->sched->now;
 
-	if (cpu->clock.div_clock >= DIV_CLOCK)
+	u64 period = cpu_clock_period(cpu, bus, DIV_CLOCK);
+	u64 ticks = (now - cpu->clock.div_tick) / period;
+	bus->mmu->io.div += (u16)ticks;
+	cpu->clock.div_tick += ticks * period;
+
+	if (!(bus->mmu->io.tac & BIT(2)))
+		return;
+
+	period = cpu_clock_period(cpu, bus, tac_cycles[bus->mmu->io.tac & 0x3]);
+	ticks = (now - cpu->clock.tima_tick) / period;
+	cpu->clock.tima_tick += ticks * period;
+
+	/* past an overflow tima carries on from tma, the overflow event is what raises the interrupt */
+	u8 tima = bus->mmu->io.tima;
+	if (ticks >= 0x100u - tima)
 	{
-		bus->mmu->io.div++;
-		cpu->clock.div_clock -= DIV_CLOCK;
+		ticks -= 0x100u - tima;
+		tima = bus->mmu->io.tma + ticks % (0x100u - bus->mmu->io.tma);
 	}
-
-	if (bus->mmu->io.tac & BIT(2))
+	else
 	{
-		usize tima_rate;
+		tima += ticks;
+	}
+	bus->mmu->io.tima = tima;
+}
 
-		switch (bus->mmu->io.tac & 0x3)
-		{
-		case 0:
-			tima_rate = 1000;
-			break;
-		case 1:
-			tima_rate = 16;
-			break;
-		case 2:
-			tima_rate = 64;
-			break;
-		case 3:
-			tima_rate = 256;
-			break;
-		}
+void cpu_reset_timers(cpu_t *cpu, bus_t *bus, u16 address)
+{
+	/* writing div clears it, & writing tac restarts tima's period */
+	if (address == MMAP_IO_DIV)
+		cpu->clock.div_tick = bus->sched->now;
+	else if (address == MMAP_IO_TAC)
+		cpu->clock.tima_tick = bus->sched->now;
+}
 
-		if (cpu->clock.tima_clock >= tima_rate)
-		{
-			if (!++bus->mmu->io.tima)
-			{
-				bus->mmu->io.tima = bus->mmu->io.tma;
-				cpu_request(cpu, bus, INT_TIMER_INDEX);
-			}
-			cpu->clock.tima_clock -= tima_rate;
-		}
+void cpu_schedule_tima(cpu_t *cpu, bus_t *bus)
+{
+	/* expects tima to be up to date, see cpu_sync_timers */
+	if (bus->mmu->io.tac & BIT(2))
+	{
+		u64 period = cpu_clock_period(cpu, bus, tac_cycles[bus->mmu->io.tac & 0x3]);
+		u64 overflow = cpu->clock.tima_tick + (0x100u - bus->mmu->io.tima) * period;
+		sched_schedule(bus->sched, EVENT_TIMA, overflow - bus->sched->now);
 	}
-	if (bus->apu->enabled)
+	else
 	{
-		usize apu_rate = bus->mmu->io.current_speed ? 0x4000 : 0x2000;
-		if (cpu->clock.fs_clock >= apu_rate)
-		{
-			apu_frame_sequencer(bus->apu);
-			cpu->clock.fs_clock -= apu_rate;
-		}
+		sched_cancel(bus->sched, EVENT_TIMA);
 	}
+}
 
-	//    for (u32 i = 0; i < cycles * (bus->mmu->io.current_speed ? 2 : 1); i++) {
-	//        u16 tac_mask;
-	//        switch (bus->mmu->io.tac & 0x3) {
-	//            case 0:
-	//                tac_mask = BIT(9);
-	//                break;
-	//            case 1:
-	//                tac_mask = BIT(3);
-	//                break;
-	//            case 2:
-	//                tac_mask = BIT(5);
-	//                break;
-	//            case 3:
-	//                tac_mask = BIT(7);
-	//                break;
-	//        }
-	//
-	//        tac_mask *= bus->mmu->io.tac & BIT(2);
-	//
-	//        u16 div_old = bus->mmu->io.div;
-	//        bus->mmu->io.div++;
-	//
-	//        bool tac_bit_old = div_old & tac_mask;
-	//        bool tac_bit = bus->mmu->io.div & tac_mask;
-	//
-	//        if (tac_bit_old && !tac_bit) {
-	//            bus->mmu->io.tima++;
-	//            if (bus->mmu->io.tima == 0) /* tima overflown */
-	//            {
-	//                bus->mmu->io.tima = bus->mmu->io.tma;
-	//                cpu_request(cpu, bus, INT_TIMER_INDEX);
-	//            }
-	//        }
-	//        if (bus->apu->enabled) {
-	//            u16 fs_mask = bus->mmu->io.current_speed ? BIT(14) : BIT(13);
-	//
-	//            bool fs_bit_old = div_old & fs_mask;
-	//            bool fs_bit = bus->mmu->io.div & fs_mask;
-	//
-	//            if (fs_bit_old && !fs_bit) {
-	//                apu_frame_sequencer(bus->apu);
-	//            }
-	//        }
-	//    }
+void cpu_tima_event(cpu_t *cpu, bus_t *bus)
+{
+	cpu_sync_timers(cpu, bus);
+	cpu_request(cpu, bus, INT_TIMER_INDEX);
+	cpu_schedule_tima(cpu, bus);
 }
@@ -1,25 +1,105 @@
 #include "core/dmg.h"
 
-void dmg_init(dmg_t *dmg, rom_t *rom, bool is_cgb, usize sample_rate, usize latency)
+#include <string.h>
+
+void dmg_init(dmg_t *dmg, rom_t *rom, bool is_cgb, usize sample_rate, usize latency, cpu_backend_t backend, ppu_renderer_t renderer)
 {
     /* initialize components */
     apu_init(&dmg->apu, sample_rate, latency);
-    cpu_init(&dmg->cpu, is_cgb);
+    cpu_init(&dmg->cpu, is_cgb, backend);
     mmu_init(&dmg->mmu, rom);
-    ppu_init(&dmg->ppu, is_cgb);
+    ppu_init(&dmg->ppu, is_cgb, renderer);
+    sched_init(&dmg->sched);
 
     /* map memory components onto bus */
-    bus_init(&dmg->bus, &dmg->cpu, &dmg->apu, &dmg->mmu, &dmg->ppu);
+    bus_init(&dmg->bus, &dmg->cpu, &dmg->apu, &dmg->mmu, &dmg->ppu, &dmg->sched);
+
+    /* schedule initial events */
+    sched_schedule(&dmg->sched, EVENT_PPU, ppu_oam_cycles(&dmg->ppu));
+    cpu_schedule_tima(&dmg->cpu, &dmg->bus);
 }
 
 void dmg_free(dmg_t *dmg)
 {
+    cpu_free(&dmg->cpu);
     mmu_free(&dmg->mmu);
 }
 
 void dmg_cycle(dmg_t *dmg)
 {
+    dmg->ppu.draw = false;
+
     cpu_cycle(&dmg->cpu, &dmg->bus);
-    ppu_cycle(&dmg->ppu, &dmg->bus, dmg->cpu.clock.cycles);
-    apu_cycle(&dmg->apu, &dmg->bus, dmg->cpu.clock.cycles);
+    dmg->sched.now += dmg->cpu.clock.cycles / 4;
+
+    /* everything else only runs once its next deadline has passed */
+    while (dmg->sched.now >= dmg->sched.next)
+        dmg_event(dmg, sched_pop(&dmg->sched));
+}
+
+usize dmg_run_cycles(dmg_t *dmg, usize cycles, dmg_output_t *output)
+{
+    /* runs until the budget (in scheduler m-cycles) is spent, v-blank is reached or the audio buffer is full */
+    u64 start = dmg->sched.now;
+    usize frame = dmg->ppu.frame;
+
+    output->audio_length = 0;
+    output->drawn = false;
+
+    /* the apu writes into the output for this run, anything that didn't fit last time going first */
+    apu_block_t block = dmg->apu.block;
+    if (output->audio)
+    {
+        apu_set_block(&dmg->apu, output->audio, output->audio_format, output->audio_capacity, NULL, NULL);
+        apu_fill(&dmg->apu);
+    }
+
+    while (dmg->sched.now - start < cycles && !(output->audio && dmg->apu.block.length == output->audio_capacity))
+    {
+        dmg_cycle(dmg);
+
+        if (dmg->ppu.frame != frame)
+        {
+            /* skipped frames (see frame_step) still end the run, but leave video alone */
+            if (dmg->ppu.draw && output->video)
+                memcpy(output->video, dmg->ppu.lcd, sizeof(dmg->ppu.lcd));
+
+            output->drawn = dmg->ppu.draw;
+            break;
+        }
+    }
+
+    if (output->audio)
+    {
+        output->audio_length = dmg->apu.block.length;
+        dmg->apu.block = block;
+    }
+
+    return dmg->sched.now - start;
+}
+
+usize dmg_run_frame(dmg_t *dmg, dmg_output_t *output)
+{
+    return dmg_run_cycles(dmg, DMG_FRAME_CYCLES, output);
+}
+
+void dmg_event(dmg_t *dmg, sched_event_t event)
+{
+    switch (event)
+    {
+    case EVENT_PPU:
+        sched_repeat(&dmg->sched, EVENT_PPU, ppu_cycle(&dmg->ppu, &dmg->bus));
+        break;
+    case EVENT_TIMA:
+        cpu_tima_event(&dmg->cpu, &dmg->bus);
+        break;
+    case EVENT_FRAME_SEQUENCER:
+        apu_sequencer_event(&dmg->apu, &dmg->bus);
+        break;
+    case EVENT_APU_SAMPLE:
+        apu_sample_event(&dmg->apu, &dmg->bus);
+        break;
+    default:
+        break;
+    }
 }
@@ -0,0 +1,271 @@
+#include "core/fifo.h"
+
+#include <string.h>
+#include "core/mmu.h"
+#include "core/ppu.h"
+
+static void fifo_push(fifo_queue_t *queue, fifo_pixel_t pixel)
+{
+    queue->pixels[(queue->head + queue->count++) & 7] = pixel;
+}
+
+static fifo_pixel_t fifo_pop(fifo_queue_t *queue)
+{
+    fifo_pixel_t pixel = queue->pixels[queue->head];
+    queue->head = (queue->head + 1) & 7;
+    queue->count--;
+    return pixel;
+}
+
+void fifo_start(ppu_t *ppu, bus_t *bus)
+{
+    fifo_t *fifo = &ppu->fifo;
+
+    if (ppu->line == 0)
+        fifo->window_line = 0;
+
+    fifo->dot = 0;
+    fifo->x = 0;
+    fifo->discard = bus->mmu->io.scx & 0x7;
+    fifo->delay = FIFO_CYCLES_START;
+    fifo->window = false;
+    fifo->done = !(bus->mmu->io.lcdc & 0x80);
+    fifo->ahead = false;
+    fifo->fetched = 0;
+
+    memset(&fifo->background, 0, sizeof(fifo->background));
+    memset(&fifo->sprites, 0, sizeof(fifo->sprites));
+    memset(&fifo->fetcher, 0, sizeof(fifo->fetcher));
+    memset(&fifo->sprite, 0, sizeof(fifo->sprite));
+}
+
+usize fifo_predict(ppu_t *ppu, bus_t *bus)
+{
+    /* draw the line whole as things stand, keeping where it started in case a write lands during mode 3 */
+    fifo_t *fifo = &ppu->fifo;
+    ppu->fifo_start = *fifo;
+    fifo_run(fifo, ppu, bus, FIFO_CYCLES_MAX);
+    fifo->ahead = true;
+
+    /* such writes only move where the line really ends by a little */
+    fifo->length = fifo->done && fifo->dot ? fifo->dot : FIFO_CYCLES_TRANSFER;
+    return fifo->length;
+}
+
+void fifo_rewind(ppu_t *ppu)
+{
+    /* back to the start of mode 3, to draw up to the write again & carry on from there with it */
+    usize length = ppu->fifo.length;
+    ppu->fifo = ppu->fifo_start;
+    ppu->fifo.length = length;
+}
+
+void fifo_run(fifo_t *fifo, ppu_t *ppu, bus_t *bus, usize dot)
+{
+    if (dot > FIFO_CYCLES_MAX)
+        dot = FIFO_CYCLES_MAX;
+
+    while (!fifo->done && fifo->dot < dot)
+        fifo_step(fifo, ppu, bus);
+}
+
+void fifo_finish(ppu_t *ppu, bus_t *bus)
+{
+    fifo_t *fifo = &ppu->fifo;
+    fifo_run(fifo, ppu, bus, FIFO_CYCLES_MAX);
+
+    /* the window picks up where it left off on the next line it's drawn on */
+    if (fifo->window)
+        fifo->window_line++;
+}
+
+void fifo_step(fifo_t *fifo, ppu_t *ppu, bus_t *bus)
+{
+    fifo->dot++;
+
+    if (fifo->delay)
+    {
+        fifo->delay--;
+        return;
+    }
+
+    /* a sprite fetch stalls both the fetcher & the shifter */
+    if (fifo->sprite.active)
+    {
+        if (++fifo->sprite.step == FIFO_CYCLES_SPRITE)
+        {
+            fifo_fetch_sprite(fifo, ppu, bus);
+            fifo->sprite.active = false;
+        }
+        return;
+    }
+
+    u8 lcdc = bus->mmu->io.lcdc;
+    u8 wx = bus->mmu->io.wx;
+
+    /* the window starts over the fetch from its own first column, & clips anything left of the screen */
+    if (!fifo->window && (lcdc & 0x20) && ppu->line >= bus->mmu->io.wy && (fifo->x + 7 == wx || (fifo->x == 0 && wx < 7)))
+    {
+        fifo->window = true;
+        fifo->discard = fifo->x == 0 ? 7 - wx : 0;
+        memset(&fifo->background, 0, sizeof(fifo->background));
+        memset(&fifo->fetcher, 0, sizeof(fifo->fetcher));
+    }
+
+    /* sprites are fetched once the shifter reaches them, after the background fetch in progress */
+    if (lcdc & 0x2)
+    {
+        for (u8 i = 0; i < ppu->oam.count; i++)
+        {
+            if ((fifo->fetched & (1 << i)) || ppu->oam.sprites[i].x > fifo->x)
+                continue;
+
+            if (fifo->fetcher.step < 6)
+            {
+                fifo_fetch(fifo, ppu, bus);
+                return;
+            }
+
+            fifo->fetched |= 1 << i;
+            fifo->sprite.active = true;
+            fifo->sprite.slot = i;
+            fifo->sprite.step = 0;
+            return;
+        }
+    }
+
+    fifo_fetch(fifo, ppu, bus);
+    fifo_shift(fifo, ppu, bus);
+}
+
+void fifo_fetch(fifo_t *fifo, ppu_t *ppu, bus_t *bus)
+{
+    mmu_t *mmu = bus->mmu;
+
+    if (fifo->fetcher.step < 7)
+        fifo->fetcher.step++;
+
+    u8 y = fifo->window ? fifo->window_line : (u8)(ppu->line + mmu->io.scy);
+
+    switch (fifo->fetcher.step)
+    {
+    case 2:
+    {
+        u16 map_address;
+        if (fifo->window)
+            map_address = ((mmu->io.lcdc & 0x40) ? 0x1C00 : 0x1800) + (y / 8) * 32 + (fifo->fetcher.x & 31);
+        else
+            map_address = ((mmu->io.lcdc & 0x8) ? 0x1C00 : 0x1800) + (y / 8) * 32 + ((mmu->io.scx / 8 + fifo->fetcher.x) & 31);
+
+        fifo->fetcher.tile_id = mmu->memory.vram[0][map_address];
+        fifo->fetcher.attributes = ppu->is_cgb ? mmu->memory.vram[1][map_address] : 0;
+        break;
+    }
+    case 6:
+    {
+        /* both bitplanes are in by now, take the row whole from the tile cache */
+        u8 attributes = fifo->fetcher.attributes;
+        u8 tile_pixel_y = (attributes & 0x40) ? 7 - y % 8 : y % 8;
+
+        u16 tile_index;
+        if (!(mmu->io.lcdc & 0x10))
+            tile_index = (u16)(256 + (i8)fifo->fetcher.tile_id);
+        else
+            tile_index = fifo->fetcher.tile_id;
+
+        u8 bank = ppu->is_cgb ? ((attributes & 0x8) ? 1 : 0) : mmu->io.vram_bank;
+        memcpy(fifo->fetcher.row, mmu_tile(mmu, bank, tile_index, attributes & 0x20) + tile_pixel_y * 8, 8);
+        break;
+    }
+    case 7:
+        /* pushed only once the last tile has been shifted out */
+        if (fifo->background.count)
+            break;
+
+        for (u8 i = 0; i < 8; i++)
+            fifo_push(&fifo->background, (fifo_pixel_t){fifo->fetcher.row[i], fifo->fetcher.attributes, 0});
+
+        fifo->fetcher.step = 0;
+        fifo->fetcher.x++;
+        break;
+    }
+}
+
+void fifo_fetch_sprite(fifo_t *fifo, ppu_t *ppu, bus_t *bus)
+{
+    ppu_sprite_t *sprite = &ppu->oam.sprites[fifo->sprite.slot];
+
+    /* tall sprites run into the next tile */
+    u8 bank = ppu->is_cgb ? ((sprite->attributes & 0x8) ? 1 : 0) : bus->mmu->io.vram_bank;
+    u8 *row = mmu_tile(bus->mmu, bank, sprite->tile_id + sprite->tile_y / 8, sprite->attributes & 0x20) + (sprite->tile_y % 8) * 8;
+
+    for (u8 tile_pixel_x = 0; tile_pixel_x < 8; tile_pixel_x++)
+    {
+        i16 x = sprite->x + tile_pixel_x;
+        if (x < fifo->x)
+            continue;
+
+        /* the sprite fifo lines up with the shifter, pad it with transparent pixels up to this one */
+        u8 slot = x - fifo->x;
+        while (fifo->sprites.count <= slot)
+            fifo_push(&fifo->sprites, (fifo_pixel_t){0, 0, 0});
+
+        /* sprites already in the fifo keep their pixels, except to a lower oam index on cgb */
+        fifo_pixel_t *pixel = &fifo->sprites.pixels[(fifo->sprites.head + slot) & 7];
+        u8 color = row[tile_pixel_x];
+
+        if (color && (!pixel->color || (ppu->is_cgb && sprite->index < pixel->sprite)))
+            *pixel = (fifo_pixel_t){color, sprite->attributes, sprite->index};
+    }
+}
+
+void fifo_shift(fifo_t *fifo, ppu_t *ppu, bus_t *bus)
+{
+    if (!fifo->background.count)
+        return;
+
+    fifo_pixel_t background = fifo_pop(&fifo->background);
+
+    /* fine scroll drops pixels off the front of the first tile */
+    if (fifo->discard)
+    {
+        fifo->discard--;
+        return;
+    }
+
+    fifo_pixel_t sprite = {0, 0, 0};
+    if (fifo->sprites.count)
+        sprite = fifo_pop(&fifo->sprites);
+
+    mmu_t *mmu = bus->mmu;
+    u8 lcdc = mmu->io.lcdc;
+
+    /* with lcdc.0 clear dmg blanks the background & window, where cgb puts sprites above them instead */
+    u8 background_color = (ppu->is_cgb || (lcdc & 0x1)) ? background.color : 0;
+
+    bool sprite_visible = sprite.color && (lcdc & 0x2);
+    if (sprite_visible && background_color)
+    {
+        if (ppu->is_cgb)
+            sprite_visible = !(lcdc & 0x1) || !((sprite.attributes & 0x80) || (background.attributes & 0x80));
+        else
+            sprite_visible = !(sprite.attributes & 0x80);
+    }
+
+    u32 color;
+    if (sprite_visible && ppu->is_cgb)
+        color = mmu->palette.foreground_colors[sprite.attributes & 0x7][sprite.color];
+    else if (sprite_visible)
+        color = mmu->palette.dmg_colors[(sprite.attributes & 0x10) ? 2 : 1][sprite.color];
+    else if (ppu->is_cgb)
+        color = mmu->palette.background_colors[background.attributes & 0x7][background.color];
+    else if (lcdc & 0x1)
+        color = mmu->palette.dmg_colors[0][background.color];
+    else
+        color = ppu_apply_dmg_palette(ppu_palette, 0);
+
+    ppu->lcd[ppu->line * LCD_WIDTH + fifo->x] = color;
+
+    if (++fifo->x == LCD_WIDTH)
+        fifo->done = true;
+}
@@ -0,0 +1,704 @@
+#if !defined(_WIN32)
+#define _DEFAULT_SOURCE /* MAP_ANONYMOUS */
+#endif
+
+#include "core/jit.h"
+
+#include <stddef.h>
+#include "core/cpu.h"
+#include "core/mmu.h"
+#include "core/sched.h"
+
+#ifdef JIT_SUPPORTED
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+#endif
+
+/* x86-64 registers, a block keeps cpu in rbx, bus in r12, the scheduler in r13 & the mmu in r14 */
+#define JIT_RAX 0
+#define JIT_RCX 1
+#define JIT_RDX 2
+#define JIT_RBX 3
+#define JIT_RSP 4
+#define JIT_RSI 6
+#define JIT_RDI 7
+#define JIT_R8 8
+#define JIT_R9 9
+#define JIT_R12 12
+#define JIT_R13 13
+#define JIT_R14 14
+
+/* integer argument registers */
+#ifdef _WIN32
+#define JIT_ARG0 JIT_RCX
+#define JIT_ARG1 JIT_RDX
+#define JIT_ARG2 JIT_R8
+#define JIT_ARG3 JIT_R9
+#define JIT_FRAME 0x28 /* shadow space, plus alignment after four pushes */
+#else
+#define JIT_ARG0 JIT_RDI
+#define JIT_ARG1 JIT_RSI
+#define JIT_ARG2 JIT_RDX
+#define JIT_ARG3 JIT_RCX
+#define JIT_FRAME 0x08
+#endif
+
+/* x86 condition codes */
+#define JIT_CC_Z 0x4
+#define JIT_CC_NZ 0x5
+#define JIT_CC_AE 0x3
+
+/* sm83 flag bits, as laid out in f */
+#define JIT_FLAG_Z 0x80
+#define JIT_FLAG_C 0x10
+
+#define JIT_CPU(member) ((u32)offsetof(cpu_t, member))
+#define JIT_F JIT_CPU(registers.f)
+#define JIT_A JIT_CPU(registers.a)
+#define JIT_HL JIT_CPU(registers.hl)
+
+/* guest register offsets, indexed the same way as the opcode encoding */
+static const u32 jit_reg8[8] = {
+    JIT_CPU(registers.b), JIT_CPU(registers.c), JIT_CPU(registers.d), JIT_CPU(registers.e),
+    JIT_CPU(registers.h), JIT_CPU(registers.l), 0, JIT_CPU(registers.a)
+};
+static const u32 jit_reg16[4] = {
+    JIT_CPU(registers.bc), JIT_CPU(registers.de), JIT_CPU(registers.hl), JIT_CPU(registers.sp)
+};
+
+/* add, adc, sub, sbc, and, xor, or, cp as `op al, cl`, in opcode order */
+static const u8 jit_alu[8] = { 0x00, 0x10, 0x28, 0x18, 0x20, 0x30, 0x08, 0x38 };
+
+bool jit_init(jit_t *jit)
+{
+    jit->code = NULL;
+    jit->used = 0;
+    jit->cycles = 0;
+
+#ifdef JIT_SUPPORTED
+#ifdef _WIN32
+    jit->code = (u8 *)VirtualAlloc(NULL, JIT_CODE_SIZE, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE);
+#else
+    void *code = mmap(NULL, JIT_CODE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    jit->code = code == MAP_FAILED ? NULL : (u8 *)code;
+#endif
+#endif
+
+    return jit->code != NULL;
+}
+
+void jit_free(jit_t *jit)
+{
+    if (!jit->code)
+        return;
+
+#ifdef JIT_SUPPORTED
+#ifdef _WIN32
+    VirtualFree(jit->code, 0, MEM_RELEASE);
+#else
+    munmap(jit->code, JIT_CODE_SIZE);
+#endif
+#endif
+
+    jit->code = NULL;
+}
+
+void jit_flush(jit_t *jit, block_cache_t *cache)
+{
+    jit->used = 0;
+
+    for (usize i = 0; i < BLOCK_CACHE_SIZE; i++)
+        cache->blocks[i].code = NULL;
+}
+
+static void jit_emit8(u8 **p, u8 value)
+{
+    *(*p)++ = value;
+}
+
+static void jit_emit16(u8 **p, u16 value)
+{
+    jit_emit8(p, (u8)value);
+    jit_emit8(p, (u8)(value >> 8));
+}
+
+static void jit_emit32(u8 **p, u32 value)
+{
+    jit_emit16(p, (u16)value);
+    jit_emit16(p, (u16)(value >> 16));
+}
+
+static void jit_emit64(u8 **p, u64 value)
+{
+    jit_emit32(p, (u32)value);
+    jit_emit32(p, (u32)(value >> 32));
+}
+
+/* emits a sequence of fixed instruction bytes */
+static void jit_emit_bytes(u8 **p, const char *bytes, usize size)
+{
+    for (usize i = 0; i < size; i++)
+        jit_emit8(p, (u8)bytes[i]);
+}
+
+#define JIT_EMIT(p, bytes) jit_emit_bytes(p, bytes, sizeof(bytes) - 1)
+
+static void jit_emit_rex(u8 **p, bool wide, u8 reg, u8 base)
+{
+    u8 rex = 0x40 | (wide << 3) | ((reg >= 8) << 2) | (base >= 8);
+    if (rex != 0x40)
+        jit_emit8(p, rex);
+}
+
+/* [base + disp32] operand */
+static void jit_emit_mem(u8 **p, u8 reg, u8 base, u32 disp)
+{
+    jit_emit8(p, 0x80 | ((reg & 7) << 3) | (base & 7));
+    if ((base & 7) == JIT_RSP)
+        jit_emit8(p, 0x24); /* rsp & r12 need a sib byte */
+    jit_emit32(p, disp);
+}
+
+/* `opcode reg, [rbx + disp]` on a guest register, for byte sized low registers only */
+static void jit_emit_cpu(u8 **p, u8 opcode, u8 reg, u32 disp)
+{
+    jit_emit8(p, opcode);
+    jit_emit_mem(p, reg, JIT_RBX, disp);
+}
+
+static void jit_emit_mov_reg(u8 **p, u8 dst, u8 src)
+{
+    jit_emit_rex(p, true, src, dst);
+    jit_emit8(p, 0x89);
+    jit_emit8(p, 0xC0 | ((src & 7) << 3) | (dst & 7));
+}
+
+static void jit_emit_mov_imm32(u8 **p, u8 dst, u32 value)
+{
+    jit_emit_rex(p, false, 0, dst);
+    jit_emit8(p, 0xB8 | (dst & 7));
+    jit_emit32(p, value);
+}
+
+static void jit_emit_store8(u8 **p, u32 disp, u8 value)
+{
+    jit_emit_cpu(p, 0xC6, 0, disp);
+    jit_emit8(p, value);
+}
+
+static void jit_emit_store16(u8 **p, u32 disp, u16 value)
+{
+    jit_emit8(p, 0x66);
+    jit_emit_cpu(p, 0xC7, 0, disp);
+    jit_emit16(p, value);
+}
+
+/* adds to the cycles run by the block & to the scheduler's clock */
+static void jit_emit_cycles(u8 **p, u32 cycles)
+{
+    jit_emit_cpu(p, 0x81, 0, JIT_CPU(jit.cycles));
+    jit_emit32(p, cycles);
+
+    jit_emit_rex(p, true, 0, JIT_R13);
+    jit_emit8(p, 0x81);
+    jit_emit_mem(p, 0, JIT_R13, (u32)offsetof(sched_t, now));
+    jit_emit32(p, cycles / 4);
+}
+
+/* the target is patched in once known */
+static u8 *jit_emit_jcc(u8 **p, u8 condition)
+{
+    jit_emit8(p, 0x0F);
+    jit_emit8(p, 0x80 | condition);
+    u8 *target = *p;
+    jit_emit32(p, 0);
+    return target;
+}
+
+static u8 *jit_emit_jmp(u8 **p)
+{
+    jit_emit8(p, 0xE9);
+    u8 *target = *p;
+    jit_emit32(p, 0);
+    return target;
+}
+
+static void jit_patch(u8 *at, u8 *target)
+{
+    jit_emit32(&at, (u32)(target - (at + 4)));
+}
+
+/*
+ * resolves the guest address in a register pair through the mmu's page tables, leaving the host address in
+ * rax + rdx, pages which aren't mapped (io, oam, rom writes) jump to the interpreter instead
+ */
+static u8 *jit_emit_page(u8 **p, u32 pair, bool write)
+{
+    jit_emit8(p, 0x0F);                 /* movzx eax, word [rbx + pair] */
+    jit_emit_cpu(p, 0xB7, JIT_RAX, pair);
+    JIT_EMIT(p, "\x0F\xB6\xD0");        /* movzx edx, al */
+    JIT_EMIT(p, "\xC1\xE8\x08");        /* shr eax, 8 */
+    JIT_EMIT(p, "\x49\x8B\x84\xC6");    /* mov rax, [r14 + rax * 8 + table] */
+    jit_emit32(p, (u32)(write ? offsetof(mmu_t, map.write) : offsetof(mmu_t, map.read)));
+    JIT_EMIT(p, "\x48\x85\xC0");        /* test rax, rax */
+    return jit_emit_jcc(p, JIT_CC_Z);
+}
+
+/* resolves a constant guest address through the page tables, leaving the host page in rax */
+static u8 *jit_emit_page_const(u8 **p, u16 address, bool write)
+{
+    JIT_EMIT(p, "\x49\x8B\x86");        /* mov rax, [r14 + table + page * 8] */
+    jit_emit32(p, (u32)((write ? offsetof(mmu_t, map.write) : offsetof(mmu_t, map.read)) + (address >> 8) * sizeof(u8 *)));
+    JIT_EMIT(p, "\x48\x85\xC0");        /* test rax, rax */
+    return jit_emit_jcc(p, JIT_CC_Z);
+}
+
+/* converts the host flags from the last instruction into sm83 flags in ecx */
+static void jit_emit_flags(u8 **p, bool carry)
+{
+    JIT_EMIT(p, "\x9C\x5A");            /* pushfq, pop rdx */
+    JIT_EMIT(p, "\x89\xD1");            /* mov ecx, edx */
+    JIT_EMIT(p, "\x83\xE1\x50");        /* and ecx, zf | af */
+    JIT_EMIT(p, "\x01\xC9");            /* add ecx, ecx */
+    if (carry)
+    {
+        JIT_EMIT(p, "\x83\xE2\x01");    /* and edx, cf */
+        JIT_EMIT(p, "\xC1\xE2\x04");    /* shl edx, 4 */
+        JIT_EMIT(p, "\x09\xD1");        /* or ecx, edx */
+    }
+}
+
+/* merges ecx into f, keeping the bits in `keep` */
+static void jit_emit_store_flags(u8 **p, u8 keep)
+{
+    jit_emit_cpu(p, 0x8A, JIT_RAX, JIT_F); /* mov al, f */
+    JIT_EMIT(p, "\x24");                /* and al, keep */
+    jit_emit8(p, keep);
+    JIT_EMIT(p, "\x08\xC8");            /* or al, cl */
+    jit_emit_cpu(p, 0x88, JIT_RAX, JIT_F); /* mov f, al */
+}
+
+/* `op a, cl` for the eight alu operations */
+static void jit_emit_alu(u8 **p, u8 operation)
+{
+    jit_emit_cpu(p, 0x8A, JIT_RAX, JIT_A); /* mov al, a */
+    if (operation == 1 || operation == 3)
+    {
+        jit_emit_cpu(p, 0x8A, JIT_RDX, JIT_F); /* mov dl, f */
+        JIT_EMIT(p, "\xC0\xEA\x05");    /* shr dl, 5 (carry into cf) */
+    }
+    jit_emit8(p, jit_alu[operation]);
+    jit_emit8(p, 0xC8);
+    if (operation != 7)
+        jit_emit_cpu(p, 0x88, JIT_RAX, JIT_A); /* mov a, al (leaves the flags alone) */
+
+    jit_emit_flags(p, true);
+    switch (operation)
+    {
+    case 2: /* sub */
+    case 3: /* sbc */
+    case 7: /* cp */
+        JIT_EMIT(p, "\x83\xC9\x40");    /* or ecx, n */
+        break;
+    case 4: /* and */
+        JIT_EMIT(p, "\x81\xE1\x80\x00\x00\x00\x83\xC9\x20"); /* and ecx, z; or ecx, h */
+        break;
+    case 5: /* xor */
+    case 6: /* or */
+        JIT_EMIT(p, "\x81\xE1\x80\x00\x00\x00"); /* and ecx, z */
+        break;
+    }
+    jit_emit_store_flags(p, 0x0F);
+}
+
+/*
+ * emits an op which doesn't need the interpreter, memory accesses which miss the page tables add their jump
+ * to the slow path, returns false if the op can't be inlined at all
+ */
+static bool jit_emit_inline(u8 **p, block_op_t *op, u16 next_pc, u8 **slow)
+{
+    u8 opcode = op->opcode;
+    u8 dst = (opcode >> 3) & 7, src = opcode & 7;
+
+    /* most ops fall through, so the pc is set up front */
+    jit_emit_store16(p, JIT_CPU(registers.pc), next_pc);
+
+    switch (opcode)
+    {
+    case 0x00: /* nop */
+        return true;
+    case 0x01: /* ld rr, d16 */
+    case 0x11:
+    case 0x21:
+    case 0x31:
+        jit_emit_store16(p, jit_reg16[opcode >> 4], op->imm16);
+        return true;
+    case 0x03: /* inc rr */
+    case 0x13:
+    case 0x23:
+    case 0x33:
+    case 0x0B: /* dec rr */
+    case 0x1B:
+    case 0x2B:
+    case 0x3B:
+        jit_emit8(p, 0x66);
+        jit_emit_cpu(p, 0xFF, (opcode & 0x08) ? 1 : 0, jit_reg16[opcode >> 4]);
+        return true;
+    case 0x02: /* ld (bc), a */
+    case 0x12: /* ld (de), a */
+    case 0x22: /* ld (hl+), a */
+    case 0x32: /* ld (hl-), a */
+        *slow = jit_emit_page(p, opcode < 0x20 ? jit_reg16[opcode >> 4] : JIT_HL, true);
+        jit_emit_cpu(p, 0x8A, JIT_RCX, JIT_A);
+        JIT_EMIT(p, "\x88\x0C\x10");    /* mov [rax + rdx], cl */
+        if (opcode >= 0x20)
+        {
+            jit_emit8(p, 0x66);
+            jit_emit_cpu(p, 0xFF, opcode == 0x32 ? 1 : 0, JIT_HL);
+        }
+        return true;
+    case 0x0A: /* ld a, (bc) */
+    case 0x1A: /* ld a, (de) */
+    case 0x2A: /* ld a, (hl+) */
+    case 0x3A: /* ld a, (hl-) */
+        *slow = jit_emit_page(p, opcode < 0x20 ? jit_reg16[opcode >> 4] : JIT_HL, false);
+        JIT_EMIT(p, "\x8A\x0C\x10");    /* mov cl, [rax + rdx] */
+        jit_emit_cpu(p, 0x88, JIT_RCX, JIT_A);
+        if (opcode >= 0x20)
+        {
+            jit_emit8(p, 0x66);
+            jit_emit_cpu(p, 0xFF, opcode == 0x3A ? 1 : 0, JIT_HL);
+        }
+        return true;
+    case 0x04: /* inc r */
+    case 0x0C:
+    case 0x14:
+    case 0x1C:
+    case 0x24:
+    case 0x2C:
+    case 0x3C:
+    case 0x05: /* dec r */
+    case 0x0D:
+    case 0x15:
+    case 0x1D:
+    case 0x25:
+    case 0x2D:
+    case 0x3D:
+        jit_emit_cpu(p, 0xFE, opcode & 1, jit_reg8[dst]);
+        jit_emit_flags(p, false);
+        if (opcode & 1)
+            JIT_EMIT(p, "\x83\xC9\x40"); /* or ecx, n */
+        jit_emit_store_flags(p, 0x1F);
+        return true;
+    case 0x06: /* ld r, d8 */
+    case 0x0E:
+    case 0x16:
+    case 0x1E:
+    case 0x26:
+    case 0x2E:
+    case 0x3E:
+        jit_emit_store8(p, jit_reg8[dst], (u8)op->imm16);
+        return true;
+    case 0x36: /* ld (hl), d8 */
+        *slow = jit_emit_page(p, JIT_HL, true);
+        JIT_EMIT(p, "\xC6\x04\x10");    /* mov byte [rax + rdx], d8 */
+        jit_emit8(p, (u8)op->imm16);
+        return true;
+    case 0xE0: /* ldh (a8), a */
+    case 0xF0: /* ldh a, (a8) */
+        /* only hram is plain memory, the rest of the page is io */
+        if ((u8)op->imm16 < 0x80 || (u8)op->imm16 == 0xFF)
+            return false;
+
+        JIT_EMIT(p, "\x49\x8B\x86");    /* mov rax, [r14 + hram] */
+        jit_emit32(p, (u32)offsetof(mmu_t, memory.hram));
+        if (opcode == 0xE0)
+        {
+            jit_emit_cpu(p, 0x8A, JIT_RCX, JIT_A);
+            JIT_EMIT(p, "\x88\x88");     /* mov [rax + offset], cl */
+            jit_emit32(p, (u8)op->imm16 - 0x80);
+        }
+        else
+        {
+            JIT_EMIT(p, "\x8A\x88");     /* mov cl, [rax + offset] */
+            jit_emit32(p, (u8)op->imm16 - 0x80);
+            jit_emit_cpu(p, 0x88, JIT_RCX, JIT_A);
+        }
+        return true;
+    case 0xEA: /* ld (a16), a */
+        *slow = jit_emit_page_const(p, op->imm16, true);
+        jit_emit_cpu(p, 0x8A, JIT_RCX, JIT_A);
+        JIT_EMIT(p, "\x88\x88");         /* mov [rax + offset], cl */
+        jit_emit32(p, op->imm16 & 0xFF);
+        return true;
+    case 0xFA: /* ld a, (a16) */
+        *slow = jit_emit_page_const(p, op->imm16, false);
+        JIT_EMIT(p, "\x8A\x88");         /* mov cl, [rax + offset] */
+        jit_emit32(p, op->imm16 & 0xFF);
+        jit_emit_cpu(p, 0x88, JIT_RCX, JIT_A);
+        return true;
+    case 0x18: /* jr r8 */
+        jit_emit_store16(p, JIT_CPU(registers.pc), next_pc + (i8)op->imm16);
+        return true;
+    case 0xC3: /* jp a16 */
+        jit_emit_store16(p, JIT_CPU(registers.pc), op->imm16);
+        return true;
+    case 0x20: /* jr cc, r8 */
+    case 0x28:
+    case 0x30:
+    case 0x38:
+    case 0xC2: /* jp cc, a16 */
+    case 0xCA:
+    case 0xD2:
+    case 0xDA:
+    {
+        /* taken branches cost an extra 4 cycles */
+        jit_emit_cpu(p, 0xF6, 0, JIT_F);
+        jit_emit8(p, (dst & 2) ? JIT_FLAG_C : JIT_FLAG_Z);
+        jit_emit8(p, (dst & 1) ? 0x74 : 0x75); /* jz / jnz over the taken path */
+        u8 *skip = (*p)++;
+
+        jit_emit_store16(p, JIT_CPU(registers.pc), opcode < 0x40 ? next_pc + (i8)op->imm16 : op->imm16);
+        jit_emit_cycles(p, 4);
+        *skip = (u8)(*p - (skip + 1));
+        return true;
+    }
+    case 0xC6: /* alu a, d8 */
+    case 0xCE:
+    case 0xD6:
+    case 0xDE:
+    case 0xE6:
+    case 0xEE:
+    case 0xF6:
+    case 0xFE:
+        jit_emit8(p, 0xB1);             /* mov cl, d8 */
+        jit_emit8(p, (u8)op->imm16);
+        jit_emit_alu(p, dst);
+        return true;
+    }
+
+    if (opcode >= 0x40 && opcode < 0x80 && opcode != 0x76)
+    {
+        /* ld r, r with (hl) on either side */
+        if (src == 6)
+        {
+            *slow = jit_emit_page(p, JIT_HL, false);
+            JIT_EMIT(p, "\x8A\x0C\x10");
+        }
+        else
+        {
+            jit_emit_cpu(p, 0x8A, JIT_RCX, jit_reg8[src]);
+        }
+
+        if (dst == 6)
+        {
+            *slow = jit_emit_page(p, JIT_HL, true);
+            JIT_EMIT(p, "\x88\x0C\x10");
+        }
+        else
+        {
+            jit_emit_cpu(p, 0x88, JIT_RCX, jit_reg8[dst]);
+        }
+        return true;
+    }
+
+    if (opcode >= 0x80 && opcode < 0xC0)
+    {
+        /* alu a, r */
+        if (src == 6)
+        {
+            *slow = jit_emit_page(p, JIT_HL, false);
+            JIT_EMIT(p, "\x8A\x0C\x10");
+        }
+        else
+        {
+            jit_emit_cpu(p, 0x8A, JIT_RCX, jit_reg8[src]);
+        }
+
+        jit_emit_alu(p, dst);
+        return true;
+    }
+
+    return false;
+}
+
+/* leaves once the next event is due */
+static u8 *jit_emit_due(u8 **p)
+{
+    jit_emit_rex(p, true, JIT_RAX, JIT_R13); /* mov rax, [r13 + now] */
+    jit_emit8(p, 0x8B);
+    jit_emit_mem(p, JIT_RAX, JIT_R13, (u32)offsetof(sched_t, now));
+    jit_emit_rex(p, true, JIT_RAX, JIT_R13); /* cmp rax, [r13 + next] */
+    jit_emit8(p, 0x3B);
+    jit_emit_mem(p, JIT_RAX, JIT_R13, (u32)offsetof(sched_t, next));
+    return jit_emit_jcc(p, JIT_CC_AE);
+}
+
+#ifdef CPU_LAZY_FLAGS
+/* compiled code keeps f as a byte, so it's converted either side of the interpreter */
+static void jit_execute_op(cpu_t *cpu, bus_t *bus, u8 opcode, u16 imm16)
+{
+    cpu_flags_set(cpu, cpu->registers.f);
+    cpu_execute_op(cpu, bus, opcode, imm16);
+    cpu->registers.f = cpu_flags_get(cpu);
+}
+#define JIT_EXECUTE_OP jit_execute_op
+#else
+#define JIT_EXECUTE_OP cpu_execute_op
+#endif
+
+/* hands the op to the interpreter, then performs the same checks as cpu_retire, adding the block's exits */
+static void jit_emit_call(u8 **p, block_op_t *op, u16 bank, u8 **exits, usize *exit_count)
+{
+    jit_emit_mov_reg(p, JIT_ARG0, JIT_RBX);
+    jit_emit_mov_reg(p, JIT_ARG1, JIT_R12);
+    jit_emit_mov_imm32(p, JIT_ARG2, op->opcode);
+    jit_emit_mov_imm32(p, JIT_ARG3, op->imm16);
+    JIT_EMIT(p, "\x48\xB8");            /* mov rax, cpu_execute_op */
+    jit_emit64(p, (u64)(usize)&JIT_EXECUTE_OP);
+    JIT_EMIT(p, "\xFF\xD0");            /* call rax */
+
+    /* the interpreter leaves the op's cycles in clock.cycles */
+    jit_emit_cpu(p, 0x8B, JIT_RAX, JIT_CPU(clock.cycles));
+    jit_emit_cpu(p, 0x01, JIT_RAX, JIT_CPU(jit.cycles));
+    JIT_EMIT(p, "\xC1\xE8\x02");        /* shr eax, 2 */
+    jit_emit_rex(p, true, JIT_RAX, JIT_R13); /* add [r13 + now], rax */
+    jit_emit8(p, 0x01);
+    jit_emit_mem(p, JIT_RAX, JIT_R13, (u32)offsetof(sched_t, now));
+    exits[(*exit_count)++] = jit_emit_due(p);
+
+    /* an enabled interrupt was raised */
+    jit_emit_cpu(p, 0x80, 7, JIT_CPU(interrupt.master)); /* cmp byte master, 0 */
+    jit_emit8(p, 0);
+    JIT_EMIT(p, "\x74");                /* je over the check */
+    u8 *skip = (*p)++;
+    JIT_EMIT(p, "\x41\x8A\x86");        /* mov al, [r14 + interrupt_enable] */
+    jit_emit32(p, (u32)offsetof(mmu_t, memory.interrupt_enable));
+    JIT_EMIT(p, "\x41\x22\x86");        /* and al, [r14 + irf] */
+    jit_emit32(p, (u32)offsetof(mmu_t, io.irf));
+    exits[(*exit_count)++] = jit_emit_jcc(p, JIT_CC_NZ);
+    *skip = (u8)(*p - (skip + 1));
+
+    /* a hdma copy started */
+    JIT_EMIT(p, "\x66\x41\x83\xBE");    /* cmp word [r14 + to_copy], 0 */
+    jit_emit32(p, (u32)offsetof(mmu_t, hdma.to_copy));
+    jit_emit8(p, 0);
+    exits[(*exit_count)++] = jit_emit_jcc(p, JIT_CC_NZ);
+
+    /* the bank the block was decoded from was switched out */
+    if (bank)
+    {
+        JIT_EMIT(p, "\x66\x41\x81\xBE"); /* cmp word [r14 + rom_bank], bank */
+        jit_emit32(p, (u32)offsetof(mmu_t, rom_bank));
+        jit_emit16(p, bank);
+        exits[(*exit_count)++] = jit_emit_jcc(p, JIT_CC_NZ);
+    }
+}
+
+jit_code_t jit_compile(jit_t *jit, block_cache_t *cache, block_t *block)
+{
+    if (jit->used + JIT_BLOCK_SIZE > JIT_CODE_SIZE)
+        jit_flush(jit, cache);
+
+    u8 *start = jit->code + jit->used;
+    u8 *p = start;
+
+    u8 *exits[BLOCK_MAX_OPS * 5];
+    usize exit_count = 0;
+
+    /* prologue */
+    JIT_EMIT(&p, "\x53\x41\x54\x41\x55\x41\x56"); /* push rbx, r12, r13, r14 */
+    JIT_EMIT(&p, "\x48\x83\xEC");       /* sub rsp, frame */
+    jit_emit8(&p, JIT_FRAME);
+    jit_emit_mov_reg(&p, JIT_RBX, JIT_ARG0);
+    jit_emit_mov_reg(&p, JIT_R12, JIT_ARG1);
+    jit_emit_rex(&p, true, JIT_R13, JIT_R12); /* mov r13, [r12 + sched] */
+    jit_emit8(&p, 0x8B);
+    jit_emit_mem(&p, JIT_R13, JIT_R12, (u32)offsetof(bus_t, sched));
+    jit_emit_rex(&p, true, JIT_R14, JIT_R12); /* mov r14, [r12 + mmu] */
+    jit_emit8(&p, 0x8B);
+    jit_emit_mem(&p, JIT_R14, JIT_R12, (u32)offsetof(bus_t, mmu));
+
+    u16 pc = block->pc;
+    for (usize i = 0; i < block->length; i++)
+    {
+        block_op_t *op = &block->ops[i];
+        u16 next_pc = pc + (op->opcode == 0xCB ? 2 : opc_opcodes[op->opcode].length);
+        u8 *slow = NULL;
+
+        u8 *begin = p;
+        if (jit_emit_inline(&p, op, next_pc, &slow))
+        {
+            /*
+             * registers & mapped memory only, which can't raise an interrupt, start a dma or switch banks, so once
+             * jit_execute_block has checked those on entry an event coming due is the only reason to leave
+             */
+            jit_emit_cycles(&p, opc_opcodes[op->opcode].cycles);
+            exits[exit_count++] = jit_emit_due(&p);
+
+            if (slow)
+            {
+                /* the fast path has already moved the pc on */
+                u8 *done = jit_emit_jmp(&p);
+                jit_patch(slow, p);
+                jit_emit_store16(&p, JIT_CPU(registers.pc), pc);
+                jit_emit_call(&p, op, block->bank, exits, &exit_count);
+                jit_patch(done, p);
+            }
+        }
+        else
+        {
+            p = begin;
+            jit_emit_call(&p, op, block->bank, exits, &exit_count);
+        }
+
+        pc = next_pc;
+    }
+
+    /* epilogue */
+    for (usize i = 0; i < exit_count; i++)
+        jit_patch(exits[i], p);
+
+    JIT_EMIT(&p, "\x48\x83\xC4");       /* add rsp, frame */
+    jit_emit8(&p, JIT_FRAME);
+    JIT_EMIT(&p, "\x41\x5E\x41\x5D\x41\x5C\x5B\xC3"); /* pop r14, r13, r12, rbx, ret */
+
+    jit->used += p - start;
+    return (jit_code_t)start;
+}
+
+void jit_execute_block(cpu_t *cpu, bus_t *bus, block_t *block)
+{
+    /*
+     * compiled code only makes cpu_retire's other checks after ops handed to the interpreter, as inline ops can't
+     * change their outcome, so if one already holds the interpreter runs the single op it would before leaving
+     */
+    if (cpu_interrupted(cpu, bus, block->bank))
+    {
+        cpu_execute_block(cpu, bus, block);
+        return;
+    }
+
+    if (!block->code)
+    {
+        if (++block->hits < JIT_THRESHOLD)
+        {
+            cpu_execute_block(cpu, bus, block);
+            return;
+        }
+
+        block->code = jit_compile(&cpu->jit, &cpu->cache, block);
+    }
+
+    cpu->jit.cycles = 0;
+    cpu->registers.f = cpu_flags_get(cpu);
+    ((jit_code_t)block->code)(cpu, bus);
+    cpu_flags_set(cpu, cpu->registers.f);
+
+    /* the caller advances time by the whole block */
+    bus->sched->now -= cpu->jit.cycles / 4;
+    cpu->clock.cycles = cpu->jit.cycles;
+}
@@ -1,5 +1,7 @@
 #include "core/mmu.h"
 
+#include "core/ppu.h"
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -13,6 +15,8 @@ void mmu_init(mmu_t *mmu, rom_t *rom)
 	/* allocate memory */
 	for (usize i = 0; i < CGB_VRAM_COUNT; i++)
 		mmu->memory.vram[i] = (u8 *)malloc(VRAM_SIZE);
+	for (usize i = 0; i < CGB_VRAM_COUNT; i++)
+		mmu->tiles.decoded[i] = (u8 *)malloc(VRAM_TILE_COUNT * 2 * VRAM_TILE_SIZE);
 	for (usize i = 0; i < MBC5_XRAM_COUNT; i++)
 		mmu->memory.xram[i] = (u8 *)malloc(XRAM_SIZE);
 	for (usize i = 0; i < CGB_WRAM_COUNT; i++)
@@ -27,6 +31,8 @@ void mmu_init(mmu_t *mmu, rom_t *rom)
 	/* clear out memory */
 	for (usize i = 0; i < CGB_VRAM_COUNT; i++)
 		memset(mmu->memory.vram[i], 0, VRAM_SIZE);
+	memset(mmu->tiles.dirty, 0xFF, sizeof(mmu->tiles.dirty));
+	mmu->tiles.kernels = pixel_select();
 	for (usize i = 0; i < MBC5_XRAM_COUNT; i++)
 		memset(mmu->memory.xram[i], 0, XRAM_SIZE);
 	for (usize i = 0; i < CGB_WRAM_COUNT; i++)
@@ -38,6 +44,22 @@ void mmu_init(mmu_t *mmu, rom_t *rom)
 
 	/* setup memory */
 	mmu->io.lcdc = 0x91; // LCDC
+	mmu_update_colors(mmu);
+
+	/* build page tables, the oam & io pages are left to the slow path */
+	for (usize i = 0; i < MMU_PAGE_COUNT; i++)
+	{
+		mmu->map.read[i] = NULL;
+		mmu->map.write[i] = NULL;
+	}
+	mmu_map_pages(mmu, MMAP_ROM_00, 0x4000, mmu->memory.cart[0], false);
+	mmu_map_rom(mmu, 1);
+	mmu_map_vram(mmu);
+	mmu_map_pages(mmu, MMAP_XRAM, XRAM_SIZE, mmu->memory.xram[0], true);
+	mmu_map_pages(mmu, MMAP_WRAM, WRAM_SIZE, mmu->memory.wram[0], true);
+	mmu_map_wram(mmu);
+	mmu_map_pages(mmu, 0xE000, WRAM_SIZE, mmu->memory.wram[0], true); /* echo */
+	mmu_map_pages(mmu, 0xF000, 0xE00, mmu->memory.wram[0], true);
 
 	/* load save data */
 	if (rom->save_data)
@@ -56,6 +78,8 @@ void mmu_free(mmu_t *mmu)
 {
 	for (usize i = 0; i < CGB_VRAM_COUNT; i++)
 		free(mmu->memory.vram[i]);
+	for (usize i = 0; i < CGB_VRAM_COUNT; i++)
+		free(mmu->tiles.decoded[i]);
 	for (usize i = 0; i < MBC5_XRAM_COUNT; i++)
 		free(mmu->memory.xram[i]);
 	for (usize i = 0; i < CGB_WRAM_COUNT; i++)
@@ -65,180 +89,178 @@ void mmu_free(mmu_t *mmu)
 	free(mmu->memory.hram);
 }
 
+void mmu_map_pages(mmu_t *mmu, u16 address, usize size, u8 *memory, bool writable)
+{
+	for (usize offset = 0; offset < size; offset += MMU_PAGE_SIZE)
+	{
+		usize page = (address + offset) / MMU_PAGE_SIZE;
+
+		mmu->map.read[page] = memory + offset;
+		mmu->map.write[page] = writable ? memory + offset : NULL;
+	}
+}
+
+void mmu_map_rom(mmu_t *mmu, u16 bank)
+{
+	mmu->rom_bank = bank;
+	mmu->memory.cart[1] = mmu->memory.cart[0] + (0x4000 * bank);
+	mmu_map_pages(mmu, MMAP_ROM_01, 0x4000, mmu->memory.cart[1], false);
+}
+
+void mmu_map_vram(mmu_t *mmu)
+{
+	/* writes take the slow path, so the tile cache sees them */
+	mmu_map_pages(mmu, MMAP_VRAM, VRAM_SIZE, mmu->memory.vram[mmu->io.vram_bank], false);
+}
+
+void mmu_map_wram(mmu_t *mmu)
+{
+	u8 bank = mmu->io.svbk & 0x7;
+	mmu_map_pages(mmu, MMAP_WRAM + WRAM_SIZE, WRAM_SIZE, mmu->memory.wram[bank ? bank : 1], true);
+}
+
 u8 *mmu_map(mmu_t *mmu, u16 address)
 {
-	switch (address & 0xF000)
+	u8 *page = mmu->map.read[address >> 8];
+	if (page)
+		return &page[address & 0xFF];
+
+	return mmu_map_io(mmu, address);
+}
+
+u8 *mmu_map_io(mmu_t *mmu, u16 address)
+{
+	switch (address & 0xF00)
 	{
-	case 0x0000:
-	case 0x1000:
-	case 0x2000:
-	case 0x3000:
-		return &mmu->memory.cart[0][address];
-	case 0x4000:
-	case 0x5000:
-	case 0x6000:
-	case 0x7000:
-		return &mmu->memory.cart[1][address - 0x4000];
-	case 0x8000:
-	case 0x9000:
-		return &mmu->memory.vram[mmu->io.vram_bank][address - 0x8000];
-	case 0xA000:
-	case 0xB000:
-		return &mmu->memory.xram[0][address - 0xA000];
-	case 0xC000:
-		return &mmu->memory.wram[0][address - 0xC000];
-	case 0xD000:
-		return &mmu->memory.wram[mmu->io.svbk ? mmu->io.svbk : 1][address - 0xD000];
-	case 0xE000:
-		return &mmu->memory.wram[0][address - 0xE000];
-	case 0xF000:
-		switch (address & 0xF00)
+	case 0xE00:
+		return address < 0xFEA0 ? &mmu->memory.oam[address - 0xFE00] : &mmu->null_mem;
+	case 0xF00:
+		switch (address)
 		{
-		case 0x000:
-		case 0x100:
-		case 0x200:
-		case 0x300:
-		case 0x400:
-		case 0x500:
-		case 0x600:
-		case 0x700:
-		case 0x800:
-		case 0x900:
-		case 0xA00:
-		case 0xB00:
-		case 0xC00:
-		case 0xD00:
-			return &mmu->memory.wram[0][address - 0xF000];
-		case 0xE00:
-			return address < 0xFEA0 ? &mmu->memory.oam[address - 0xFE00] : &mmu->null_mem;
-		case 0xF00:
-			switch (address)
+		case MMAP_IO_JOYP:
+		{
+			u8 original = mmu->io.joyp & 0x30;
+			u8 input = 0b11000000;
+
+			/* unpack buttons, so we can modify them */
+			u8 right = mmu->buttons.right;
+			u8 left = mmu->buttons.left;
+			u8 up = mmu->buttons.up;
+			u8 down = mmu->buttons.down;
+			u8 a = mmu->buttons.a;
+			u8 b = mmu->buttons.b;
+			u8 select = mmu->buttons.select;
+			u8 start = mmu->buttons.start;
+
+			/* you couldn't actually press two opposite directions at once */
+			if (right && left)
+			{
+				right = 0;
+				left = 0;
+			}
+			if (up && down)
 			{
-			case MMAP_IO_JOYP:
+				up = 0;
+				down = 0;
+			}
+
+			if (!(mmu->io.joyp & 0x10)) /* directions */
 			{
-				u8 original = mmu->io.joyp & 0x30;
-				u8 input = 0b11000000;
-
-				/* unpack buttons, so we can modify them */
-				u8 right = mmu->buttons.right;
-				u8 left = mmu->buttons.left;
-				u8 up = mmu->buttons.up;
-				u8 down = mmu->buttons.down;
-				u8 a = mmu->buttons.a;
-				u8 b = mmu->buttons.b;
-				u8 select = mmu->buttons.select;
-				u8 start = mmu->buttons.start;
-
-				/* you couldn't actually press two opposite directions at once */
-				if (right && left)
-				{
-					right = 0;
-					left = 0;
-				}
-				if (up && down)
-				{
-					up = 0;
-					down = 0;
-				}
-
-				if (!(mmu->io.joyp & 0x10)) /* directions */
-				{
-					input |= (right ? 0 : 0b00000001);
-					input |= (left ? 0 : 0b00000010);
-					input |= (up ? 0 : 0b00000100);
-					input |= (down ? 0 : 0b00001000);
-				}
-				else if (!(mmu->io.joyp & 0x20)) /* actions */
-				{
-					input |= (a ? 0 : 0b00000001);
-					input |= (b ? 0 : 0b00000010);
-					input |= (select ? 0 : 0b00000100);
-					input |= (start ? 0 : 0b00001000);
-				}
-				else
-				{
-					input |= 0b00001111;
-				}
-				mmu->io.joyp = input | original;
-				return &mmu->io.joyp;
+				input |= (right ? 0 : 0b00000001);
+				input |= (left ? 0 : 0b00000010);
+				input |= (up ? 0 : 0b00000100);
+				input |= (down ? 0 : 0b00001000);
 			}
-				//			case MMAP_IO_DIV: /* handled by mmu_peek & mmu_poke */
-				//				return &mmu->io.div;
-			case MMAP_IO_TIMA:
-				return &mmu->io.tima;
-			case MMAP_IO_TMA:
-				return &mmu->io.tma;
-			case MMAP_IO_TAC:
-				return &mmu->io.tac;
-			case MMAP_IO_IRF:
-				return &mmu->io.irf;
-			case MMAP_IO_LCDC:
-				return &mmu->io.lcdc;
-			case MMAP_IO_STAT:
-				return &mmu->io.stat;
-			case MMAP_IO_SCY:
-				return &mmu->io.scy;
-			case MMAP_IO_SCX:
-				return &mmu->io.scx;
-			case MMAP_IO_LY:
-				return &mmu->io.ly;
-			case MMAP_IO_LYC:
-				return &mmu->io.lyc;
-			case MMAP_IO_DMA:
-				return &mmu->io.dma;
-			case MMAP_IO_BGP:
-				return &mmu->io.bgp;
-			case MMAP_IO_OBP0:
-				return &mmu->io.obp0;
-			case MMAP_IO_OBP1:
-				return &mmu->io.obp1;
-			case MMAP_IO_WY:
-				return &mmu->io.wy;
-			case MMAP_IO_WX:
-				return &mmu->io.wx;
-			case MMAP_IO_KEY1:
-				mmu->io.key1 |= 0x7E;
-				return &mmu->io.key1;
-			case MMAP_IO_VBK:
-				mmu->io.vbk |= 0xFE;
-				return &mmu->io.vbk;
-			case MMAP_IO_HDMA1:
-				return &mmu->io.hdma1;
-			case MMAP_IO_HDMA2:
-				return &mmu->io.hdma2;
-			case MMAP_IO_HDMA3:
-				return &mmu->io.hdma3;
-			case MMAP_IO_HDMA4:
-				return &mmu->io.hdma4;
-			case MMAP_IO_HDMA5:
-				return &mmu->io.hdma5;
-			case MMAP_IO_BGPI:
-				return &mmu->io.bgpi;
-			case MMAP_IO_BGPD:
-				return &mmu->io.bgpd;
-			case MMAP_IO_OBPI:
-				return &mmu->io.obpi;
-			case MMAP_IO_OBPD:
-				return &mmu->io.obpd;
-			case MMAP_IO_SVBK:
-				return &mmu->io.svbk;
-			case MMAP_IE:
-				return &mmu->memory.interrupt_enable;
-			default:
-				switch (address & 0xF0)
-				{
-				case 0x00:
-				case 0x10:
-				case 0x20:
-				case 0x30:
-				case 0x40:
-				case 0x50:
-				case 0x60:
-				case 0x70:
-					return &mmu->memory.io[address - 0xFF00];
-				}
-				return &mmu->memory.hram[address - 0xFF80];
+			else if (!(mmu->io.joyp & 0x20)) /* actions */
+			{
+				input |= (a ? 0 : 0b00000001);
+				input |= (b ? 0 : 0b00000010);
+				input |= (select ? 0 : 0b00000100);
+				input |= (start ? 0 : 0b00001000);
 			}
+			else
+			{
+				input |= 0b00001111;
+			}
+			mmu->io.joyp = input | original;
+			return &mmu->io.joyp;
+		}
+			//			case MMAP_IO_DIV: /* handled by mmu_peek & mmu_poke */
+			//				return &mmu->io.div;
+		case MMAP_IO_TIMA:
+			return &mmu->io.tima;
+		case MMAP_IO_TMA:
+			return &mmu->io.tma;
+		case MMAP_IO_TAC:
+			return &mmu->io.tac;
+		case MMAP_IO_IRF:
+			return &mmu->io.irf;
+		case MMAP_IO_LCDC:
+			return &mmu->io.lcdc;
+		case MMAP_IO_STAT:
+			return &mmu->io.stat;
+		case MMAP_IO_SCY:
+			return &mmu->io.scy;
+		case MMAP_IO_SCX:
+			return &mmu->io.scx;
+		case MMAP_IO_LY:
+			return &mmu->io.ly;
+		case MMAP_IO_LYC:
+			return &mmu->io.lyc;
+		case MMAP_IO_DMA:
+			return &mmu->io.dma;
+		case MMAP_IO_BGP:
+			return &mmu->io.bgp;
+		case MMAP_IO_OBP0:
+			return &mmu->io.obp0;
+		case MMAP_IO_OBP1:
+			return &mmu->io.obp1;
+		case MMAP_IO_WY:
+			return &mmu->io.wy;
+		case MMAP_IO_WX:
+			return &mmu->io.wx;
+		case MMAP_IO_KEY1:
+			mmu->io.key1 |= 0x7E;
+			return &mmu->io.key1;
+		case MMAP_IO_VBK:
+			mmu->io.vbk |= 0xFE;
+			return &mmu->io.vbk;
+		case MMAP_IO_HDMA1:
+			return &mmu->io.hdma1;
+		case MMAP_IO_HDMA2:
+			return &mmu->io.hdma2;
+		case MMAP_IO_HDMA3:
+			return &mmu->io.hdma3;
+		case MMAP_IO_HDMA4:
+			return &mmu->io.hdma4;
+		case MMAP_IO_HDMA5:
+			return &mmu->io.hdma5;
+		case MMAP_IO_BGPI:
+			return &mmu->io.bgpi;
+		case MMAP_IO_BGPD:
+			return &mmu->io.bgpd;
+		case MMAP_IO_OBPI:
+			return &mmu->io.obpi;
+		case MMAP_IO_OBPD:
+			return &mmu->io.obpd;
+		case MMAP_IO_SVBK:
+			return &mmu->io.svbk;
+		case MMAP_IE:
+			return &mmu->memory.interrupt_enable;
+		default:
+			switch (address & 0xF0)
+			{
+			case 0x00:
+			case 0x10:
+			case 0x20:
+			case 0x30:
+			case 0x40:
+			case 0x50:
+			case 0x60:
+			case 0x70:
+				return &mmu->memory.io[address - 0xFF00];
+			}
+			return &mmu->memory.hram[address - 0xFF80];
 		}
 	default:
 		printf("[!] unable to map mmu address `0x%04X`", address);
@@ -248,6 +270,10 @@ u8 *mmu_map(mmu_t *mmu, u16 address)
 
 u8 mmu_peek(mmu_t *mmu, u16 address)
 {
+	u8 *page = mmu->map.read[address >> 8];
+	if (page)
+		return page[address & 0xFF];
+
 	switch (address)
 	{
 	case MMAP_IO_DIV:
@@ -257,13 +283,26 @@ u8 mmu_peek(mmu_t *mmu, u16 address)
 	case MMAP_IO_OBPD:
 		return mmu->palette.foreground[mmu->io.obpi & 0x3F];
 	}
-	return *mmu_map(mmu, address);
+	return *mmu_map_io(mmu, address);
 }
 
 void mmu_poke(mmu_t *mmu, u16 address, u8 value)
 {
+	u8 *page = mmu->map.write[address >> 8];
+	if (page)
+	{
+		page[address & 0xFF] = value;
+		return;
+	}
+
 	if (address >= 0x8000) // disallow writing to rom
 	{
+		if (address < MMAP_VRAM + VRAM_SIZE)
+		{
+			mmu_poke_vram(mmu, address, value);
+			return;
+		}
+
 		switch (address)
 		{
 		case MMAP_IO_JOYP:
@@ -320,6 +359,7 @@ void mmu_poke(mmu_t *mmu, u16 address, u8 value)
 			return;
 		case MMAP_IO_BGPD:
 			mmu->palette.background[mmu->io.bgpi & 0x3F] = value;
+			mmu_update_cgb_color(mmu->palette.background, mmu->palette.background_colors, mmu->io.bgpi & 0x3F);
 			if (mmu->io.bgpi & 0x80)
 			{
 				mmu->io.bgpi = (((mmu->io.bgpi & 0x3F) + 1) & 0x3F) | 0x80;
@@ -327,13 +367,38 @@ void mmu_poke(mmu_t *mmu, u16 address, u8 value)
 			return;
 		case MMAP_IO_OBPD:
 			mmu->palette.foreground[mmu->io.obpi & 0x3F] = value;
+			mmu_update_cgb_color(mmu->palette.foreground, mmu->palette.foreground_colors, mmu->io.obpi & 0x3F);
 			if (mmu->io.obpi & 0x80)
 			{
 				mmu->io.obpi = (((mmu->io.obpi & 0x3F) + 1) & 0x3F) | 0x80;
 			}
 			return;
+		case MMAP_IO_BGP:
+			mmu->io.bgp = value;
+			mmu_update_dmg_colors(mmu->palette.dmg_colors[0], value);
+			return;
+		case MMAP_IO_OBP0:
+			mmu->io.obp0 = value;
+			mmu_update_dmg_colors(mmu->palette.dmg_colors[1], value);
+			return;
+		case MMAP_IO_OBP1:
+			mmu->io.obp1 = value;
+			mmu_update_dmg_colors(mmu->palette.dmg_colors[2], value);
+			return;
+		case MMAP_IO_STAT:
+			/* the mode & coincidence bits are only updated by the ppu */
+			mmu->io.stat = (value & 0xF8) | (mmu->io.stat & 0x07);
+			return;
+		case MMAP_IO_VBK:
+			mmu->io.vbk = value;
+			mmu_map_vram(mmu);
+			return;
+		case MMAP_IO_SVBK:
+			mmu->io.svbk = value;
+			mmu_map_wram(mmu);
+			return;
 		}
-		*mmu_map(mmu, address) = value;
+		*mmu_map_io(mmu, address) = value;
 	}
 	else
 	{
@@ -348,7 +413,7 @@ void mmu_poke(mmu_t *mmu, u16 address, u8 value)
 		case 0x2000:
 			if (value <= 0x80)
 			{
-				mmu->memory.cart[1] = mmu->memory.cart[0] + (0x4000 * (value ? value : 1)); // todo: check this should go up to 1
+				mmu_map_rom(mmu, value ? value : 1); // todo: check this should go up to 1
 			}
 			break;
 		case 0x3000:
@@ -382,3 +447,65 @@ void mmu_hdma_copy_block(mmu_t *mmu)
 	mmu->io.hdma4 = mmu->hdma.destination & 0xFF;
 	mmu->io.hdma5 = mmu->hdma.length ? (mmu->hdma.length >> 4) - 1 : 0xFF;
 }
+
+void mmu_update_cgb_color(u8 *palette, u32 colors[][4], u8 index)
+{
+	/* colours are two bytes, little-endian */
+	u8 id = index & 0x3E;
+	colors[id / 8][(id / 2) % 4] = ppu_apply_cgb_palette(palette[id] | (palette[id + 1] << 8));
+}
+
+void mmu_update_dmg_colors(u32 colors[4], u8 palette)
+{
+	for (u8 color_id = 0; color_id < 4; color_id++)
+		colors[color_id] = ppu_apply_dmg_palette(ppu_palette, ppu_convert_dmg_palette(palette, color_id));
+}
+
+void mmu_update_colors(mmu_t *mmu)
+{
+	for (u8 index = 0; index < CGB_PALETTE_COUNT; index += 2)
+	{
+		mmu_update_cgb_color(mmu->palette.background, mmu->palette.background_colors, index);
+		mmu_update_cgb_color(mmu->palette.foreground, mmu->palette.foreground_colors, index);
+	}
+
+	mmu_update_dmg_colors(mmu->palette.dmg_colors[0], mmu->io.bgp);
+	mmu_update_dmg_colors(mmu->palette.dmg_colors[1], mmu->io.obp0);
+	mmu_update_dmg_colors(mmu->palette.dmg_colors[2], mmu->io.obp1);
+}
+
+void mmu_poke_vram(mmu_t *mmu, u16 address, u8 value)
+{
+	u16 offset = address - MMAP_VRAM;
+	u8 *byte = &mmu->memory.vram[mmu->io.vram_bank][offset];
+
+	if (*byte == value)
+		return;
+	*byte = value;
+
+	/* tile data ends where the tile maps start */
+	u16 index = offset / 16;
+	if (index < VRAM_TILE_COUNT)
+		mmu->tiles.dirty[mmu->io.vram_bank][index / 32] |= 1u << (index % 32);
+}
+
+void mmu_decode_tile(mmu_t *mmu, u8 bank, u16 index)
+{
+	u8 *tile = &mmu->tiles.decoded[bank][index * 2 * VRAM_TILE_SIZE];
+	mmu->tiles.kernels->decode_tile(&mmu->memory.vram[bank][index * 16], tile, tile + VRAM_TILE_SIZE);
+}
+
+u8 *mmu_tile(mmu_t *mmu, u8 bank, u16 index, bool flip_x)
+{
+	/* eight rows of eight colour ids, y flips just read the rows backwards */
+	u32 *dirty = &mmu->tiles.dirty[bank][index / 32];
+	u32 mask = 1u << (index % 32);
+
+	if (*dirty & mask)
+	{
+		mmu_decode_tile(mmu, bank, index);
+		*dirty &= ~mask;
+	}
+
+	return &mmu->tiles.decoded[bank][(index * 2 + flip_x) * VRAM_TILE_SIZE];
+}
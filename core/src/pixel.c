@@ -0,0 +1,130 @@
+#include "core/pixel.h"
+
+#ifdef PIXEL_SIMD
+#include <immintrin.h>
+#endif
+
+/* one byte set in every lane, to spread a bitplane byte across eight lanes */
+#define PIXEL_SPREAD 0x0101010101010101ULL
+
+static void pixel_decode_tile_scalar(const u8 *data, u8 *tile, u8 *flipped)
+{
+    for (u8 y = 0; y < 8; y++)
+    {
+        u8 pixel_line_1 = data[y * 2 + 1];
+        u8 pixel_line_2 = data[y * 2 + 0];
+
+        for (u8 x = 0; x < 8; x++)
+        {
+            u8 pixel = (((pixel_line_1 >> (7 - x)) & 1) << 1) | ((pixel_line_2 >> (7 - x)) & 1);
+            tile[y * 8 + x] = pixel;
+            flipped[y * 8 + (7 - x)] = pixel;
+        }
+    }
+}
+
+static void pixel_apply_palette_scalar(const u8 *ids, const u32 *palette, u32 *pixels, usize count)
+{
+    for (usize i = 0; i < count; i++)
+        pixels[i] = palette[ids[i]];
+}
+
+pixel_kernels_t pixel_kernels_scalar = {"scalar", pixel_decode_tile_scalar, pixel_apply_palette_scalar};
+
+#ifdef PIXEL_SIMD
+__attribute__((target("sse2"))) static void pixel_decode_tile_sse2(const u8 *data, u8 *tile, u8 *flipped)
+{
+    /* each lane tests its own bit, leftmost pixel first (or last when flipped) */
+    __m128i bits = _mm_set_epi8(1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128);
+    __m128i bits_flipped = _mm_set_epi8(-128, 64, 32, 16, 8, 4, 2, 1, -128, 64, 32, 16, 8, 4, 2, 1);
+    __m128i one = _mm_set1_epi8(1);
+
+    /* two rows at a time */
+    for (u8 y = 0; y < 8; y += 2)
+    {
+        __m128i lo = _mm_set_epi64x((long long)(data[y * 2 + 2] * PIXEL_SPREAD), (long long)(data[y * 2 + 0] * PIXEL_SPREAD));
+        __m128i hi = _mm_set_epi64x((long long)(data[y * 2 + 3] * PIXEL_SPREAD), (long long)(data[y * 2 + 1] * PIXEL_SPREAD));
+
+        __m128i ids = _mm_or_si128(
+            _mm_and_si128(_mm_cmpeq_epi8(_mm_and_si128(lo, bits), bits), one),
+            _mm_and_si128(_mm_cmpeq_epi8(_mm_and_si128(hi, bits), bits), _mm_add_epi8(one, one)));
+        __m128i ids_flipped = _mm_or_si128(
+            _mm_and_si128(_mm_cmpeq_epi8(_mm_and_si128(lo, bits_flipped), bits_flipped), one),
+            _mm_and_si128(_mm_cmpeq_epi8(_mm_and_si128(hi, bits_flipped), bits_flipped), _mm_add_epi8(one, one)));
+
+        _mm_storeu_si128((__m128i *)&tile[y * 8], ids);
+        _mm_storeu_si128((__m128i *)&flipped[y * 8], ids_flipped);
+    }
+}
+
+/* selecting colours by comparison loses to scalar loads without ssse3's byte shuffle, so only decoding is vectorised */
+pixel_kernels_t pixel_kernels_sse2 = {"sse2", pixel_decode_tile_sse2, pixel_apply_palette_scalar};
+
+__attribute__((target("avx2"))) static void pixel_decode_tile_avx2(const u8 *data, u8 *tile, u8 *flipped)
+{
+    __m256i bits = _mm256_set1_epi64x((long long)0x0102040810204080ULL);
+    __m256i bits_flipped = _mm256_set1_epi64x((long long)0x8040201008040201ULL);
+    __m256i one = _mm256_set1_epi8(1);
+    __m256i two = _mm256_set1_epi8(2);
+
+    /* four rows at a time */
+    for (u8 y = 0; y < 8; y += 4)
+    {
+        const u8 *row = &data[y * 2];
+        __m256i lo = _mm256_set_epi64x((long long)(row[6] * PIXEL_SPREAD), (long long)(row[4] * PIXEL_SPREAD),
+                                       (long long)(row[2] * PIXEL_SPREAD), (long long)(row[0] * PIXEL_SPREAD));
+        __m256i hi = _mm256_set_epi64x((long long)(row[7] * PIXEL_SPREAD), (long long)(row[5] * PIXEL_SPREAD),
+                                       (long long)(row[3] * PIXEL_SPREAD), (long long)(row[1] * PIXEL_SPREAD));
+
+        __m256i ids = _mm256_or_si256(
+            _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_and_si256(lo, bits), bits), one),
+            _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_and_si256(hi, bits), bits), two));
+        __m256i ids_flipped = _mm256_or_si256(
+            _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_and_si256(lo, bits_flipped), bits_flipped), one),
+            _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_and_si256(hi, bits_flipped), bits_flipped), two));
+
+        _mm256_storeu_si256((__m256i *)&tile[y * 8], ids);
+        _mm256_storeu_si256((__m256i *)&flipped[y * 8], ids_flipped);
+    }
+}
+
+__attribute__((target("avx2"))) static void pixel_apply_palette_avx2(const u8 *ids, const u32 *palette, u32 *pixels, usize count)
+{
+    /* colour ids are below 4, so only the low half of the table is ever indexed */
+    __m256i colors = _mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)palette));
+
+    usize i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256i id = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)&ids[i]));
+        _mm256_storeu_si256((__m256i *)&pixels[i], _mm256_permutevar8x32_epi32(colors, id));
+    }
+
+    for (; i < count; i++)
+        pixels[i] = palette[ids[i]];
+}
+
+pixel_kernels_t pixel_kernels_avx2 = {"avx2", pixel_decode_tile_avx2, pixel_apply_palette_avx2};
+#endif
+
+bool pixel_supported(pixel_kernels_t *kernels)
+{
+#ifdef PIXEL_SIMD
+    if (kernels == &pixel_kernels_avx2)
+        return __builtin_cpu_supports("avx2");
+    if (kernels == &pixel_kernels_sse2)
+        return __builtin_cpu_supports("sse2");
+#endif
+    return kernels == &pixel_kernels_scalar;
+}
+
+pixel_kernels_t *pixel_select(void)
+{
+#ifdef PIXEL_SIMD
+    if (pixel_supported(&pixel_kernels_avx2))
+        return &pixel_kernels_avx2;
+    if (pixel_supported(&pixel_kernels_sse2))
+        return &pixel_kernels_sse2;
+#endif
+    return &pixel_kernels_scalar;
+}
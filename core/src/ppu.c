@@ -1,9 +1,11 @@
 #include <stdio.h>
+#include <string.h>
 #include "core/ppu.h"
 
 #include "core/cpu.h"
 #include "core/mmu.h"
 #include "core/bus.h"
+#include "core/sched.h"
 
 u8 ppu_palette[12] =
 	{
@@ -12,43 +14,29 @@ u8 ppu_palette[12] =
 		0x34, 0x68, 0x56,
 		0x08, 0x18, 0x20};
 
-void ppu_init(ppu_t *ppu, bool is_cgb)
+void ppu_init(ppu_t *ppu, bool is_cgb, ppu_renderer_t renderer)
 {
 	ppu->mode = MODE_OAM;
-	ppu->cycles = 0;
 	ppu->line = 0; // todo: check this
 	ppu->enabled = true;
 	ppu->is_cgb = is_cgb;
 	ppu->frame = 0;
 	ppu->frame_step = 1;
 	ppu->draw = false;
+	ppu->oam.count = 0;
+	ppu->raster.count = 0;
+	ppu->raster.drawn = 0;
+	ppu->kernels = pixel_select();
+	ppu->renderer = renderer;
+	ppu->fifo.window_line = 0;
 
 	for (usize i = 0; i < LCD_WIDTH * LCD_HEIGHT; i++)
 		ppu->lcd[i] = 0;
 }
 
-void ppu_enable(ppu_t *ppu)
-{
-	if (!ppu->enabled)
-	{
-		ppu->enabled = true;
-	}
-}
-
-void ppu_disable(ppu_t *ppu)
-{
-	ppu->line = 248;
-
-	for (usize x = 0; x < LCD_WIDTH; x++)
-		for (usize y = 0; y < LCD_HEIGHT; y++)
-			ppu_set_pixel(ppu, x, y, 0xFFFFFFFF);
-
-	ppu->enabled = false;
-}
-
 void ppu_update_ly(ppu_t *ppu, bus_t *bus)
 {
-	ppu->line = (ppu->line + 1) % SCANLINE_MAX;
+	ppu->line = (ppu->line + 1) % (SCANLINE_MAX + 1);
 	bus->mmu->io.ly = ppu->line;
 }
 
@@ -75,89 +63,202 @@ void ppu_set_stat_mode(ppu_t *ppu, bus_t *bus)
 	}
 }
 
-void ppu_cycle(ppu_t *ppu, bus_t *bus, usize cycles)
+usize ppu_oam_cycles(ppu_t *ppu)
 {
-	ppu->interrupt.v_blank = false;
-	ppu->interrupt.lcd_stat = false;
-	ppu->draw = false;
+	return ppu->renderer == PPU_RENDERER_FIFO ? FIFO_CYCLES_OAM_SCAN : CYCLES_OAM_ACCESS;
+}
+
+void ppu_enable(ppu_t *ppu, bus_t *bus)
+{
+	/* starts over from the oam scan of line 0 */
+	ppu->enabled = true;
+	ppu->line = 0;
+	bus->mmu->io.ly = 0;
+	ppu_compare_ly_lyc(ppu, bus);
+
+	ppu->mode = MODE_OAM;
+	ppu_scan_oam(ppu, bus);
+	ppu_set_stat_mode(ppu, bus);
+	bus->mmu->io.stat = (bus->mmu->io.stat & 0xFC) | ppu->mode;
+
+	sched_schedule(bus->sched, EVENT_PPU, ppu_oam_cycles(ppu));
+}
+
+void ppu_disable(ppu_t *ppu, bus_t *bus)
+{
+	/* blanked once, ly & the mode stay at 0 until the lcd is turned back on */
+	for (usize i = 0; i < LCD_WIDTH * LCD_HEIGHT; i++)
+		ppu->lcd[i] = 0xFFFFFFFF;
+
+	ppu->enabled = false;
+	ppu->line = 0;
+	bus->mmu->io.ly = 0;
+
+	ppu->mode = MODE_H_BLANK;
+	ppu->raster.count = 0;
+	ppu->raster.drawn = 0;
+	bus->mmu->io.stat &= 0xFC;
+
+	/* frames still go by, so the frontend keeps presenting the blank screen */
+	sched_schedule(bus->sched, EVENT_PPU, CYCLES_FRAME);
+}
+
+usize ppu_cycle(ppu_t *ppu, bus_t *bus)
+{
+	/* called when the current mode runs out, returns the length of the next one */
+	usize cycles = 0;
 
 	bool drawing = (ppu->frame % ppu->frame_step) == 0;
 
+	/* with the lcd off only whole frames pass */
+	if (!ppu->enabled)
+	{
+		ppu->draw = drawing;
+		ppu->frame++;
+		return CYCLES_FRAME;
+	}
+
 	switch (ppu->mode)
 	{
 	case MODE_H_BLANK:
-		if (CYCLES_ELAPSED(ppu, CYCLES_H_BLANK))
-		{
-			ppu_update_ly(ppu, bus);
-			ppu_compare_ly_lyc(ppu, bus);
-
-			if (ppu->line == SCANLINE_V_BLANK)
-			{
-				ppu->interrupt.v_blank = true;
-				ppu->draw = drawing;
-				ppu->mode = MODE_V_BLANK;
-				ppu_set_stat_mode(ppu, bus); // TODO: check
-				ppu->frame++;
-			}
-			else
-			{
-				ppu->mode = MODE_OAM;
-			}
+		ppu_update_ly(ppu, bus);
+		ppu_compare_ly_lyc(ppu, bus);
 
-			ppu_set_stat_mode(ppu, bus);
-			ppu->cycles -= CYCLES_H_BLANK;
+		if (ppu->line == SCANLINE_V_BLANK)
+		{
+			ppu->interrupt.v_blank = true;
+			ppu->draw = drawing;
+			ppu->mode = MODE_V_BLANK;
+			ppu_set_stat_mode(ppu, bus); // TODO: check
+			ppu->frame++;
+			cycles = CYCLES_LINE;
+		}
+		else
+		{
+			ppu->mode = MODE_OAM;
+			ppu_scan_oam(ppu, bus);
+			cycles = ppu_oam_cycles(ppu);
 		}
+
+		ppu_set_stat_mode(ppu, bus);
 		break;
 	case MODE_OAM:
-		if (CYCLES_ELAPSED(ppu, CYCLES_OAM_ACCESS))
+		ppu->mode = MODE_LCD_TRANSFER;
+
+		if (ppu->renderer == PPU_RENDERER_FIFO)
+		{
+			/* the fifo always draws, as mode 3 lasts as long as it takes to */
+			fifo_start(ppu, bus);
+			cycles = fifo_predict(ppu, bus);
+		}
+		else
 		{
-			ppu->mode = MODE_LCD_TRANSFER;
-			ppu->cycles -= CYCLES_OAM_ACCESS;
+			cycles = CYCLES_LCD_TRANSFER;
 		}
 		break;
 	case MODE_LCD_TRANSFER:
-		if (CYCLES_ELAPSED(ppu, CYCLES_LCD_TRANSFER))
+	{
+		if (ppu->renderer == PPU_RENDERER_FIFO)
+			fifo_finish(ppu, bus);
+
+		if (drawing && ppu->renderer == PPU_RENDERER_SCANLINE)
 		{
-			u8 lcd_enable = (bus->mmu->io.lcdc & 0x80) != 0;
+			ppu_render_line(ppu, bus, LCD_WIDTH);
+		}
+		ppu->raster.count = 0;
+		ppu->raster.drawn = 0;
+		ppu->mode = MODE_H_BLANK;
 
-			if (lcd_enable)
-				ppu_enable(ppu);
-			else
-				ppu_disable(ppu);
+		/* hdma transfer */
+		if (bus->mmu->hdma.hblank && bus->mmu->hdma.length > 0)
+			bus->mmu->hdma.to_copy = 0x10;
 
-			if (lcd_enable && drawing)
-			{
-				ppu_render_line(ppu, bus);
-			}
-			ppu->mode = MODE_H_BLANK;
+		ppu_set_stat_mode(ppu, bus);
 
-			/* hdma transfer */
-			if (bus->mmu->hdma.hblank && bus->mmu->hdma.length > 0)
-				bus->mmu->hdma.to_copy = 0x10;
+		/* h-blank makes up the rest of the line after a longer or shorter mode 3 */
+		if (ppu->renderer == PPU_RENDERER_FIFO)
+			cycles = CYCLES_LINE - FIFO_CYCLES_OAM_SCAN - ppu->fifo.length;
+		else
+			cycles = CYCLES_H_BLANK;
+		break;
+	}
+	case MODE_V_BLANK:
+		ppu_update_ly(ppu, bus);
+		ppu_compare_ly_lyc(ppu, bus);
 
+		if (ppu->line == 0)
+		{
+			ppu->mode = MODE_OAM;
+			ppu_scan_oam(ppu, bus);
 			ppu_set_stat_mode(ppu, bus);
-			ppu->cycles -= CYCLES_LCD_TRANSFER;
+			cycles = ppu_oam_cycles(ppu);
 		}
-		break;
-	case MODE_V_BLANK:
-		if (CYCLES_ELAPSED(ppu, CYCLES_LINE))
+		else
 		{
-			ppu_update_ly(ppu, bus);
-			ppu_compare_ly_lyc(ppu, bus);
-
-			if (ppu->line == 0)
-			{
-				ppu->mode = MODE_OAM;
-				ppu_set_stat_mode(ppu, bus);
-			}
-
-			ppu->cycles -= CYCLES_LINE;
+			cycles = CYCLES_LINE;
 		}
 		break;
 	}
 
 	bus->mmu->io.stat = (bus->mmu->io.stat & 0xFC) | ppu->mode;
-	ppu->cycles += cycles / 4;
+	return cycles;
+}
+
+void ppu_sync(ppu_t *ppu, bus_t *bus, u16 address)
+{
+	if (ppu->renderer != PPU_RENDERER_FIFO || ppu->mode != MODE_LCD_TRANSFER)
+		return;
+
+	/* only vram, oam & the lcd registers change what's drawn */
+	if (address < MMAP_VRAM || (address >= MMAP_XRAM && address < MMAP_OAM) || (address >= MMAP_IO && address < MMAP_IO_LCDC) || address > MMAP_IO_OBPD)
+		return;
+
+	if (ppu->fifo.ahead)
+		fifo_rewind(ppu);
+
+	/* mode 3 started its length before the next ppu event, draw up to the dot we're on */
+	u64 start = bus->sched->deadline[EVENT_PPU] - ppu->fifo.length;
+	if (bus->sched->now > start)
+		fifo_run(&ppu->fifo, ppu, bus, bus->sched->now - start);
+}
+
+void ppu_log_write(ppu_t *ppu, bus_t *bus, u16 address, u8 value)
+{
+	/* the registers the scanline renderer can split a line on */
+	switch (address)
+	{
+	case MMAP_IO_LCDC:
+	case MMAP_IO_SCY:
+	case MMAP_IO_SCX:
+	case MMAP_IO_BGP:
+	case MMAP_IO_OBP0:
+	case MMAP_IO_OBP1:
+	case MMAP_IO_WY:
+	case MMAP_IO_WX:
+		break;
+	default:
+		return;
+	}
+
+	/* pixels come out a dot at a time once the first tile is fetched */
+	u64 start = bus->sched->deadline[EVENT_PPU] - CYCLES_LCD_TRANSFER + CYCLES_RASTER_DELAY + (bus->mmu->io.scx & 0x7);
+	u64 x = bus->sched->now > start ? bus->sched->now - start : 0;
+	if (x > LCD_WIDTH)
+		x = LCD_WIDTH;
+
+	/* out of room, so draw the line up to here & log the rest of it afresh */
+	if (ppu->raster.count == MAX_RASTER_WRITES)
+	{
+		if ((ppu->frame % ppu->frame_step) == 0)
+			ppu_render_line(ppu, bus, x);
+		ppu->raster.count = 0;
+	}
+
+	ppu_write_t *write = &ppu->raster.writes[ppu->raster.count++];
+	write->x = x;
+	write->address = address & 0xFF;
+	write->previous = mmu_peek(bus->mmu, address);
+	write->value = value;
 }
 
 void ppu_set_pixel(ppu_t *ppu, usize x, usize y, u32 value)
@@ -172,31 +273,18 @@ u32 ppu_get_pixel(ppu_t *ppu, usize x, usize y)
 
 u8 ppu_get_tile(ppu_t *ppu, bus_t *bus, u8 tile_id, usize tile_x, usize tile_y, bool is_sprite, u8 vram_bank)
 {
-	u16 tile_addr;
+	u16 tile_index;
 
 	if (!(bus->mmu->io.lcdc & 0x10) && !is_sprite)
-		tile_addr = (u16)(0x1000 + 16 * (i8)tile_id);
+		tile_index = (u16)(256 + (i8)tile_id);
 	else
-		tile_addr = tile_id * 16;
+		tile_index = tile_id;
 
-	/* read out each line part, assumes little-endian */
-	u8 pixel_line_1, pixel_line_2;
+	/* dmg reads tile data from the mapped bank, tall sprites run into the next tile */
+	u8 bank = ppu->is_cgb ? vram_bank : bus->mmu->io.vram_bank;
+	u8 *tile = mmu_tile(bus->mmu, bank, tile_index + tile_y / 8, false);
 
-	if (ppu->is_cgb)
-	{
-		pixel_line_1 = bus->mmu->memory.vram[vram_bank][(tile_addr + tile_y * 2) + 1];
-		pixel_line_2 = bus->mmu->memory.vram[vram_bank][(tile_addr + tile_y * 2) + 0];
-	}
-	else
-	{
-		pixel_line_1 = mmu_peek(bus->mmu, MMAP_VRAM + (tile_addr + tile_y * 2) + 1);
-		pixel_line_2 = mmu_peek(bus->mmu, MMAP_VRAM + (tile_addr + tile_y * 2) + 0);
-	}
-
-	u8 pixel_mask = 0x80 >> tile_x;
-	u8 pixel = (((pixel_line_1 & pixel_mask) != 0) << 1) | ((pixel_line_2 & pixel_mask) != 0);
-
-	return pixel;
+	return tile[(tile_y % 8) * 8 + tile_x];
 }
 
 u8 ppu_convert_dmg_palette(u8 palette, u8 color_id)
@@ -228,107 +316,123 @@ u32 ppu_apply_cgb_palette(u16 raw_color)
 	return (0xFF << 24) | (b << 16) | (g << 8) | r;
 }
 
-bg_t ppu_render_background(ppu_t *ppu, bus_t *bus, u8 x, u8 y, u8 is_window)
+void ppu_render_tiles(ppu_t *ppu, bus_t *bus, ppu_line_t *line, usize start, usize end, u8 x, u8 y, u8 is_window)
 {
 	u16 map_area = ((bus->mmu->io.lcdc & 0x8) && !is_window) || ((bus->mmu->io.lcdc & 0x40) && is_window) ? 0x1C00 : 0x1800;
+	u16 map_row = map_area + (y / 8) * 32;
+
+	/* tile data follows the mapped bank on dmg, like a cpu read */
+	u8 dmg_bank = bus->mmu->io.vram_bank;
 
-	u8 tile_x = x / 8;
-	u8 tile_y = y / 8;
+	u32 *pixels = &ppu->lcd[ppu->line * LCD_WIDTH];
 
-	u8 tile_pixel_x = x % 8;
-	u8 tile_pixel_y = y % 8;
+	/* fetch the map entry & a decoded tile row once per tile column */
+	for (usize pixel = start; pixel < end;)
+	{
+		u16 map_address = map_row + x / 8;
 
-	u8 cgb_attributes = ppu->is_cgb ? bus->mmu->memory.vram[1][map_area + (tile_x + tile_y * 32)] : 0;
+		u8 tile_id = bus->mmu->memory.vram[0][map_address];
+		u8 cgb_attributes = ppu->is_cgb ? bus->mmu->memory.vram[1][map_address] : 0;
 
-	if (cgb_attributes & 0x20)
-		tile_pixel_x = 7 - tile_pixel_x;
-	if (cgb_attributes & 0x40)
-		tile_pixel_y = 7 - tile_pixel_y;
+		u8 tile_pixel_y = (cgb_attributes & 0x40) ? 7 - y % 8 : y % 8;
 
-	u8 cgb_vbank = (cgb_attributes & 0x8) ? 1 : 0;
+		u16 tile_index;
+		if (!(bus->mmu->io.lcdc & 0x10))
+			tile_index = (u16)(256 + (i8)tile_id);
+		else
+			tile_index = tile_id;
 
-	u16 map_address = map_area + tile_x + tile_y * 32;
-	u8 tile_id = bus->mmu->memory.vram[0][map_address];
-	u8 tile = ppu_get_tile(ppu, bus, tile_id, tile_pixel_x, tile_pixel_y, false, cgb_vbank);
+		u8 bank = ppu->is_cgb ? ((cgb_attributes & 0x8) ? 1 : 0) : dmg_bank;
+		u8 *row = mmu_tile(bus->mmu, bank, tile_index, cgb_attributes & 0x20) + tile_pixel_y * 8;
 
-	bg_t pixel;
-	pixel.tile = tile;
-	pixel.attributes = cgb_attributes;
+		/* the first column may start part way into its tile, the rest are whole */
+		u8 tile_pixel_x = x % 8;
+		usize left = 8 - tile_pixel_x;
+		usize count = left < end - pixel ? left : end - pixel;
 
-	if (ppu->is_cgb)
-	{
-		u8 cgb_palette = cgb_attributes & 0x7;
-		pixel.color = ppu_apply_cgb_palette(ppu_convert_cgb_palette(bus, bus->mmu->palette.background, cgb_palette, tile));
+		ppu->kernels->apply_palette(row + tile_pixel_x, line->palette[cgb_attributes & 0x7], &pixels[pixel], count);
+		memcpy(&line->tiles[pixel], row + tile_pixel_x, count);
+		memset(&line->attributes[pixel], cgb_attributes, count);
+
+		pixel += count;
+		x += count;
 	}
-	else
+}
+
+void ppu_scan_oam(ppu_t *ppu, bus_t *bus)
+{
+	u8 sprite_height = (bus->mmu->io.lcdc & 0x4) ? 16 : 8;
+
+	/* the first ten sprites in oam that cover the line are drawn, whether they're on screen or not */
+	ppu->oam.count = 0;
+	for (usize i_sprite = 0; i_sprite < 40 && ppu->oam.count < MAX_SPRITES; i_sprite++)
 	{
-		pixel.color = ppu_apply_dmg_palette(ppu_palette, ppu_convert_dmg_palette(bus->mmu->io.bgp, tile));
-	}
+		u8 *entry = &bus->mmu->memory.oam[i_sprite * 4];
+		i16 sprite_y = entry[0] - 16;
+
+		if ((i16)ppu->line < sprite_y || (i16)ppu->line >= sprite_y + sprite_height)
+			continue;
+
+		ppu_sprite_t sprite;
+		sprite.x = entry[1] - 8;
+		sprite.tile_id = entry[2] & (sprite_height == 8 ? 0xFF : 0xFE);
+		sprite.attributes = entry[3];
+		sprite.tile_y = ppu->line - sprite_y;
+		sprite.index = i_sprite;
 
-	return pixel;
+		if (sprite.attributes & 0x40)
+			sprite.tile_y = sprite_height - 1 - sprite.tile_y;
+
+		/* keep the list in drawing priority, dmg puts the leftmost sprite on top & cgb goes by oam order */
+		usize i = ppu->oam.count++;
+		if (!ppu->is_cgb)
+		{
+			for (; i > 0 && ppu->oam.sprites[i - 1].x > sprite.x; i--)
+				ppu->oam.sprites[i] = ppu->oam.sprites[i - 1];
+		}
+		ppu->oam.sprites[i] = sprite;
+	}
 }
 
-void ppu_render_sprites(ppu_t *ppu, bus_t *bus, usize x, usize y, u8 bg_tile)
+void ppu_render_sprites(ppu_t *ppu, bus_t *bus, ppu_line_t *line, usize start, usize end)
 {
-	u8 sprite_height = (bus->mmu->io.lcdc & 0x4) ? 16 : 8;
+	u32 *pixels = &ppu->lcd[ppu->line * LCD_WIDTH];
+	u8 dmg_bank = bus->mmu->io.vram_bank;
+
+	/* a pixel belongs to the first opaque sprite over it, even when the background then hides it */
+	bool *taken = line->taken;
 
-	usize max_draw = 10;
-	for (usize i_sprite = 40; i_sprite-- > 0 && max_draw;) // iterate backwards to ensure sprite ordering
+	for (usize i = 0; i < ppu->oam.count; i++)
 	{
-		u16 sprite_address = i_sprite * 4;
+		ppu_sprite_t *sprite = &ppu->oam.sprites[i];
+
+		/* tall sprites run into the next tile */
+		u8 bank = ppu->is_cgb ? ((sprite->attributes & 0x8) ? 1 : 0) : dmg_bank;
+		u8 *row = mmu_tile(bus->mmu, bank, sprite->tile_id + sprite->tile_y / 8, sprite->attributes & 0x20) + (sprite->tile_y % 8) * 8;
+
+		u32 *colors;
+		if (ppu->is_cgb)
+			colors = bus->mmu->palette.foreground_colors[sprite->attributes & 0x7];
+		else
+			colors = bus->mmu->palette.dmg_colors[(sprite->attributes & 0x10) ? 2 : 1];
 
-		/* check sprite active */
-		if (bus->mmu->memory.oam[sprite_address]) // checks y coordinate != 0
+		for (u8 tile_pixel_x = 0; tile_pixel_x < 8; tile_pixel_x++)
 		{
-			i16 sprite_x = bus->mmu->memory.oam[sprite_address + 1] - 8;
-			i16 sprite_y = bus->mmu->memory.oam[sprite_address + 0] - 16;
-			u8 sprite_tile_id = bus->mmu->memory.oam[sprite_address + 2] & (sprite_height == 8 ? 0xFF : 0xFE);
-			u8 sprite_tile_attributes = bus->mmu->memory.oam[sprite_address + 3];
-
-			u8 palette = sprite_tile_attributes & 0x10 ? bus->mmu->io.obp1 : bus->mmu->io.obp0;
-
-			/* check sprite bounds */
-			if ((i16)y >= sprite_y && (i16)y < sprite_y + sprite_height)
-			{
-				if ((i16)x >= sprite_x && (i16)x < sprite_x + 8)
-				{
-					u8 cgb_palette = sprite_tile_attributes & 0x7;
-					u8 flip_x = sprite_tile_attributes & 0x20;
-					u8 flip_y = sprite_tile_attributes & 0x40;
-					u8 priority = !(sprite_tile_attributes & 0x80);
-
-					i16 pixel_x = (x - sprite_x) % 8;
-					i16 pixel_y = (y - sprite_y) % sprite_height;
-
-					if (flip_x)
-						pixel_x = 7 - pixel_x;
-					if (flip_y)
-						pixel_y = sprite_height - 1 - pixel_y;
-
-					u8 pixel = ppu_get_tile(ppu, bus, sprite_tile_id, pixel_x, pixel_y, true, (sprite_tile_attributes & 0x8) ? 1 : 0);
-
-					u32 palette_pixel;
-					if (!ppu->is_cgb)
-						palette_pixel = ppu_apply_dmg_palette(ppu_palette, ppu_convert_dmg_palette(palette, pixel));
-					else
-						palette_pixel = ppu_apply_cgb_palette(ppu_convert_cgb_palette(bus, bus->mmu->palette.foreground, cgb_palette, pixel));
-
-					if (pixel)
-					{
-						if (sprite_tile_attributes & BIT(7))
-						{
-							if (!bg_tile)
-								ppu_set_pixel(ppu, x, y, palette_pixel);
-						}
-						else
-						{
-							ppu_set_pixel(ppu, x, y, palette_pixel);
-						}
-					}
-				}
-
-				// max_draw--; // todo: figure out maximum draw
-			}
+			i16 x = sprite->x + tile_pixel_x;
+			if (x < (i16)start || x >= (i16)end || taken[x])
+				continue;
+
+			u8 pixel = row[tile_pixel_x];
+			if (!pixel)
+				continue;
+
+			taken[x] = true;
+
+			/* background colours 1-3 stay on top of sprites flagged behind it, & of cgb tiles with priority set */
+			if (line->tiles[x] && ((sprite->attributes & 0x80) || (line->attributes[x] & 0x80)))
+				continue;
+
+			pixels[x] = colors[pixel];
 		}
 	}
 }
@@ -345,7 +449,7 @@ void ppu_debug_bg(ppu_t *ppu, bus_t *bus, usize x, usize y)
 	}
 }
 
-void ppu_render_line(ppu_t *ppu, bus_t *bus)
+void ppu_render_span(ppu_t *ppu, bus_t *bus, ppu_line_t *line, usize start, usize end)
 {
 	u8 scroll_x = bus->mmu->io.scx;
 	u8 scroll_y = bus->mmu->io.scy;
@@ -357,25 +461,70 @@ void ppu_render_line(ppu_t *ppu, bus_t *bus)
 	int window_x = ((int)bus->mmu->io.wx) - 7;
 	int window_y = bus->mmu->io.wy;
 
-	for (usize x = 0; x < LCD_WIDTH; x++)
+	/* the window covers everything right of its start */
+	usize window_start = LCD_WIDTH;
+	if (window_enable && ppu->line >= window_y && window_x < LCD_WIDTH)
+		window_start = window_x > 0 ? window_x : 0;
+
+	usize split = window_start < start ? start : window_start < end ? window_start : end;
+
+	if (background_enable && start < split) // todo check LCDC.3 only if not a window
+		ppu_render_tiles(ppu, bus, line, start, split, scroll_x + start, ppu->line + scroll_y, false);
+
+	if (split < end)
+		ppu_render_tiles(ppu, bus, line, split, end, split - window_x, ppu->line - window_y, true);
+
+	if (sprites_enable) // render sprites
+		ppu_render_sprites(ppu, bus, line, start, end);
+}
+
+void ppu_render_line(ppu_t *ppu, bus_t *bus, usize end)
+{
+	/* draws on from wherever the line was left up to end, through the writes logged since */
+	ppu_line_t *line = &ppu->raster.line;
+	usize start = ppu->raster.drawn;
+
+	if (!start)
 	{
-		bg_t bg_pixel;
-		if (window_enable && (ppu->line >= window_y && (int)x >= window_x))
-		{
-			bg_pixel = ppu_render_background(ppu, bus, x - window_x, ppu->line - window_y, true);
-			ppu_set_pixel(ppu, x, ppu->line, bg_pixel.color); // todo check LCDC.3 only if not a window
-		}
-		else if (background_enable) // render background
-		{
-			bg_pixel = ppu_render_background(ppu, bus, x + scroll_x, ppu->line + scroll_y, false);
-			ppu_set_pixel(ppu, x, ppu->line, bg_pixel.color);
-		}
+		/* pixels left undrawn by both layers keep the last frame's colour, & count as colour 0 for sprites */
+		memset(line, 0, sizeof(*line));
+
+		/* dmg tiles have no attributes, so always use the first palette */
+		line->palette = ppu->is_cgb ? bus->mmu->palette.background_colors : bus->mmu->palette.dmg_colors;
+	}
+	ppu->raster.drawn = end;
+
+	if (!ppu->raster.count)
+	{
+		ppu_render_span(ppu, bus, line, start, end);
+		return;
+	}
+
+	/* wind the registers back to how they were at start, then forward through each write as the line is drawn */
+	u8 live[MAX_RASTER_WRITES];
+	for (usize i = ppu->raster.count; i-- > 0;)
+	{
+		live[i] = mmu_peek(bus->mmu, 0xFF00 | ppu->raster.writes[i].address);
+		mmu_poke(bus->mmu, 0xFF00 | ppu->raster.writes[i].address, ppu->raster.writes[i].previous);
+	}
 
-		if (sprites_enable && ((!(bg_pixel.attributes & 0x80)) || (!bg_pixel.tile))) // render sprites
+	for (usize i = 0; i < ppu->raster.count; i++)
+	{
+		ppu_write_t *write = &ppu->raster.writes[i];
+
+		if (write->x > start)
 		{
-			ppu_render_sprites(ppu, bus, x, ppu->line, bg_pixel.tile);
+			ppu_render_span(ppu, bus, line, start, write->x);
+			start = write->x;
 		}
 
-		//			 ppu_debug_bg(ppu, bus, x, ppu->line);
+		mmu_poke(bus->mmu, 0xFF00 | write->address, write->value);
 	}
+
+	if (start < end)
+		ppu_render_span(ppu, bus, line, start, end);
+
+	/* the registers are left as the cpu left them, whatever the log held */
+	for (usize i = 0; i < ppu->raster.count; i++)
+		mmu_poke(bus->mmu, 0xFF00 | ppu->raster.writes[i].address, live[i]);
 }
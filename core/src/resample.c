@@ -0,0 +1,167 @@
+#include "core/resample.h"
+
+#include <math.h>
+#include <string.h>
+
+#ifdef RESAMPLE_SIMD
+#include <immintrin.h>
+#endif
+
+#define RESAMPLE_PI 3.14159265358979323846
+
+static void resample_filter_scalar(const f32 *taps, const f32 *left, const f32 *right, f32 *output)
+{
+    f32 sum_left = 0, sum_right = 0;
+    for (usize i = 0; i < RESAMPLE_TAPS; i++)
+    {
+        sum_left += taps[i] * left[i];
+        sum_right += taps[i] * right[i];
+    }
+
+    output[0] = sum_left;
+    output[1] = sum_right;
+}
+
+resample_kernels_t resample_kernels_scalar = {"scalar", resample_filter_scalar};
+
+#ifdef RESAMPLE_SIMD
+__attribute__((target("sse2"))) static void resample_filter_sse2(const f32 *taps, const f32 *left, const f32 *right, f32 *output)
+{
+    __m128 sum_left = _mm_setzero_ps();
+    __m128 sum_right = _mm_setzero_ps();
+
+    for (usize i = 0; i < RESAMPLE_TAPS; i += 4)
+    {
+        __m128 tap = _mm_loadu_ps(taps + i);
+        sum_left = _mm_add_ps(sum_left, _mm_mul_ps(tap, _mm_loadu_ps(left + i)));
+        sum_right = _mm_add_ps(sum_right, _mm_mul_ps(tap, _mm_loadu_ps(right + i)));
+    }
+
+    /* fold the lanes of both sums together, left ending up in the first lane & right in the second */
+    __m128 sum = _mm_add_ps(_mm_unpacklo_ps(sum_left, sum_right), _mm_unpackhi_ps(sum_left, sum_right));
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    _mm_storel_pi((__m64 *)output, sum);
+}
+
+resample_kernels_t resample_kernels_sse2 = {"sse2", resample_filter_sse2};
+
+__attribute__((target("avx2,fma"))) static void resample_filter_avx2(const f32 *taps, const f32 *left, const f32 *right, f32 *output)
+{
+    __m256 sum_left = _mm256_setzero_ps();
+    __m256 sum_right = _mm256_setzero_ps();
+
+    for (usize i = 0; i < RESAMPLE_TAPS; i += 8)
+    {
+        __m256 tap = _mm256_loadu_ps(taps + i);
+        sum_left = _mm256_fmadd_ps(tap, _mm256_loadu_ps(left + i), sum_left);
+        sum_right = _mm256_fmadd_ps(tap, _mm256_loadu_ps(right + i), sum_right);
+    }
+
+    __m128 half_left = _mm_add_ps(_mm256_castps256_ps128(sum_left), _mm256_extractf128_ps(sum_left, 1));
+    __m128 half_right = _mm_add_ps(_mm256_castps256_ps128(sum_right), _mm256_extractf128_ps(sum_right, 1));
+
+    __m128 sum = _mm_add_ps(_mm_unpacklo_ps(half_left, half_right), _mm_unpackhi_ps(half_left, half_right));
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    _mm_storel_pi((__m64 *)output, sum);
+}
+
+resample_kernels_t resample_kernels_avx2 = {"avx2", resample_filter_avx2};
+#endif
+
+bool resample_supported(resample_kernels_t *kernels)
+{
+#ifdef RESAMPLE_SIMD
+    if (kernels == &resample_kernels_avx2)
+        return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    if (kernels == &resample_kernels_sse2)
+        return __builtin_cpu_supports("sse2");
+#endif
+    return kernels == &resample_kernels_scalar;
+}
+
+resample_kernels_t *resample_select(void)
+{
+#ifdef RESAMPLE_SIMD
+    if (resample_supported(&resample_kernels_avx2))
+        return &resample_kernels_avx2;
+    if (resample_supported(&resample_kernels_sse2))
+        return &resample_kernels_sse2;
+#endif
+    return &resample_kernels_scalar;
+}
+
+void resample_init(resample_t *resample, usize input_rate, usize output_rate)
+{
+    resample->kernels = resample_select();
+    resample->base_step = ((u64)input_rate << 32) / output_rate;
+    resample->step = resample->base_step;
+    resample->position = 0;
+    resample->length = 0;
+
+    /* cut off below the lower nyquist frequency, so going down in rate doesn't fold anything back */
+    double cutoff = RESAMPLE_CUTOFF * (output_rate < input_rate ? (double)output_rate / input_rate : 1);
+
+    for (usize phase = 0; phase < RESAMPLE_PHASES; phase++)
+    {
+        double taps[RESAMPLE_TAPS], total = 0;
+
+        for (usize i = 0; i < RESAMPLE_TAPS; i++)
+        {
+            /* distance from the output sample, which sits just past the middle input sample */
+            double x = (double)i - (RESAMPLE_TAPS / 2 - 1) - (double)phase / RESAMPLE_PHASES;
+            double t = RESAMPLE_PI * cutoff * x;
+            double sinc = x == 0 ? 1 : sin(t) / t;
+            double window = 0.42 + 0.5 * cos(2 * RESAMPLE_PI * x / RESAMPLE_TAPS) + 0.08 * cos(4 * RESAMPLE_PI * x / RESAMPLE_TAPS);
+
+            taps[i] = sinc * window;
+            total += taps[i];
+        }
+
+        /* unity gain at dc for every phase */
+        for (usize i = 0; i < RESAMPLE_TAPS; i++)
+            resample->taps[phase][i] = (f32)(taps[i] / total);
+    }
+}
+
+void resample_adjust(resample_t *resample, f32 ratio)
+{
+    /* above 1 makes more output from the same input, below 1 less */
+    resample->step = (u64)(resample->base_step / (double)ratio);
+}
+
+usize resample_read(resample_t *resample, i16 *samples_i16, f32 *samples_f32, usize count)
+{
+    usize written = 0;
+
+    while (written < count && (resample->position >> 32) + RESAMPLE_TAPS <= resample->length)
+    {
+        usize index = resample->position >> 32;
+        usize phase = (resample->position & U32_MAX) * RESAMPLE_PHASES >> 32;
+
+        f32 output[2];
+        resample->kernels->filter(resample->taps[phase], &resample->input[0][index], &resample->input[1][index], output);
+
+        for (usize channel = 0; channel < 2; channel++)
+        {
+            if (samples_f32)
+                samples_f32[written * 2 + channel] = output[channel];
+            if (samples_i16)
+            {
+                f32 sample = output[channel] * 32768.0f;
+                samples_i16[written * 2 + channel] = sample < I16_MIN ? I16_MIN : sample > I16_MAX ? I16_MAX : (i16)sample;
+            }
+        }
+
+        written++;
+        resample->position += resample->step;
+    }
+
+    /* drop the input the filter has moved past */
+    usize consumed = resample->position >> 32;
+    for (usize channel = 0; channel < 2; channel++)
+        memmove(resample->input[channel], resample->input[channel] + consumed, (resample->length - consumed) * sizeof(f32));
+
+    resample->length -= consumed;
+    resample->position -= (u64)consumed << 32;
+    return written;
+}
@@ -0,0 +1,60 @@
+#include "core/sched.h"
+
+void sched_init(sched_t *sched)
+{
+    sched->now = 0;
+
+    for (usize i = 0; i < EVENT_COUNT; i++)
+        sched->deadline[i] = SCHED_NEVER;
+
+    sched_update(sched);
+}
+
+void sched_update(sched_t *sched)
+{
+    sched->next = SCHED_NEVER;
+
+    for (usize i = 0; i < EVENT_COUNT; i++)
+    {
+        if (sched->deadline[i] < sched->next)
+            sched->next = sched->deadline[i];
+    }
+}
+
+void sched_schedule(sched_t *sched, sched_event_t event, u64 cycles)
+{
+    sched->deadline[event] = sched->now + cycles;
+    sched_update(sched);
+}
+
+void sched_repeat(sched_t *sched, sched_event_t event, u64 cycles)
+{
+    /* measured from the last deadline rather than now, so periodic events don't drift */
+    sched->deadline[event] += cycles;
+    sched_update(sched);
+}
+
+void sched_cancel(sched_t *sched, sched_event_t event)
+{
+    sched->deadline[event] = SCHED_NEVER;
+    sched_update(sched);
+}
+
+bool sched_scheduled(sched_t *sched, sched_event_t event)
+{
+    return sched->deadline[event] != SCHED_NEVER;
+}
+
+sched_event_t sched_pop(sched_t *sched)
+{
+    /* the handler is responsible for repeating or cancelling the returned event */
+    sched_event_t event = EVENT_NONE;
+
+    for (usize i = 0; i < EVENT_COUNT; i++)
+    {
+        if (sched->deadline[i] <= sched->now && (event == EVENT_NONE || sched->deadline[i] < sched->deadline[event]))
+            event = i;
+    }
+
+    return event;
+}
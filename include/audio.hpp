@@ -1,26 +1,39 @@
-
 #ifndef AUDIO_HPP
 #define AUDIO_HPP
 
+#include <atomic>
 #define SDL_MAIN_HANDLED
 #include <SDL.h>
 #include "core/util.h"
 #include "core/dmg.hpp"
+#include "ring_buffer.hpp"
 
 #define AUDIO_FORMAT AUDIO_S16SYS
 #define AUDIO_CHANNELS 2
+#define AUDIO_BLOCK 256 /* sample pairs the apu hands over at a time */
 
 struct Audio
 {
     SDL_AudioDeviceID device;
 
     gmb::APU apu;
+    RingBuffer ring; /* filled by the emulation thread, drained by the device's callback */
+    bool playing;
+
+    std::atomic<usize> underruns; /* callbacks that ran out of samples & played silence for the rest */
+    std::atomic<usize> overruns; /* blocks that didn't fit & were cut short */
+
+    static constexpr f32 max_deviation = 0.005f; /* furthest rate control strays from the sample rate, well under what's heard as pitch */
 
     Audio(gmb::APU& apu);
     ~Audio();
 
-    void queue(i16* sample, usize length);
+    void queue(const i16* samples, usize length);
+    void stop();
     usize queued();
+    f32 rate();
+
+    static void callback(void* userdata, u8* stream, int length);
 };
 
 #endif
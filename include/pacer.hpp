@@ -0,0 +1,30 @@
+#ifndef PACER_HPP
+#define PACER_HPP
+
+#include <chrono>
+#include "core/util.h"
+
+/*
+ * keeps emulation at real speed on a monotonic clock, sleeping most of each wait & spinning only the end of it,
+ * either against emulated time (a CYCLES_FRAME of 70224 cycles at CPU_FREQUENCY, the dmg's 59.7275 hz) or against how much audio is still queued
+ */
+struct Pacer
+{
+    using clock = std::chrono::steady_clock;
+
+    static constexpr auto spin_margin = std::chrono::microseconds(1500); /* os sleeps can overshoot by about this much */
+    static constexpr auto max_lag = std::chrono::milliseconds(100); /* further behind than this & the schedule starts over from now */
+
+    clock::time_point deadline;
+
+    Pacer();
+
+    void reset();
+
+    void wait(usize cycles, usize speed = 1);
+    void wait_audio(usize queued, usize target, usize sample_rate);
+
+    void sleep_until(clock::time_point time);
+};
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef RING_BUFFER_HPP
+#define RING_BUFFER_HPP
+
+#include <atomic>
+#include <memory>
+#include "core/util.h"
+
+/*
+ * single producer, single consumer queue of samples without locks, the producer only moves head & the consumer only tail
+ */
+struct RingBuffer
+{
+    std::unique_ptr<i16[]> samples;
+    usize mask; /* capacity is a power of two, so positions wrap with a mask */
+
+    std::atomic<usize> head; /* total samples written */
+    std::atomic<usize> tail; /* total samples read */
+
+    RingBuffer(usize capacity);
+
+    usize capacity();
+    usize size();
+
+    usize write(const i16* data, usize count);
+    usize read(i16* data, usize count);
+    void clear(); /* consumer side, only while nothing else is reading */
+};
+
+#endif
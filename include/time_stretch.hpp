@@ -0,0 +1,32 @@
+#ifndef TIME_STRETCH_HPP
+#define TIME_STRETCH_HPP
+
+#include <vector>
+#include "core/util.h"
+
+/*
+ * plays a sped up stream back at normal speed without shifting its pitch (wsola), by overlap-adding short sequences
+ * of it, each one placed where it lines up best with the end of the one before
+ */
+struct TimeStretch
+{
+    usize sequence; /* sample pairs taken per step, output less the overlap */
+    usize overlap;  /* sample pairs crossfaded between one sequence & the next */
+    usize seek;     /* sample pairs searched past the nominal start for the best fit */
+
+    f32 tempo = 1;      /* input consumed per sample output */
+    f32 position = 0;   /* nominal start of the next sequence in input, in sample pairs */
+
+    std::vector<i16> input; /* interleaved left & right, waiting to be stretched */
+    std::vector<i16> tail;  /* what followed the last sequence, which the next fades in over */
+
+    TimeStretch(usize sample_rate);
+
+    void reset();
+    void process(const i16* samples, usize length, std::vector<i16>& output);
+
+    usize best_offset(usize start);
+    f32 correlation(usize start, usize step);
+};
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef TRIPLE_BUFFER_HPP
+#define TRIPLE_BUFFER_HPP
+
+#include <atomic>
+#include <memory>
+#include "core/util.h"
+
+/*
+ * hands whole frames from one writer thread to one reader thread without either waiting on the other,
+ * the writer always has a buffer to draw into & the reader always gets the newest finished frame
+ */
+struct TripleBuffer
+{
+    static constexpr u8 fresh = 0x4; /* set alongside the shared index while it holds a frame the reader hasn't taken */
+
+    std::unique_ptr<u32[]> buffers[3];
+    std::atomic<u8> shared;
+    u8 back, front;
+
+    TripleBuffer(usize size);
+
+    u32* write_buffer();
+    void publish();
+
+    bool acquire();
+    const u32* read_buffer();
+};
+
+#endif
@@ -22,19 +22,15 @@ struct Window
     SDL_Texture* texture;
     std::unique_ptr<u32[]> pixels;
 
-    u32 last_time = 0;
-
     const u8* keys;
 
-    gmb::PPU ppu;
-
-    Window(gmb::PPU& ppu);
+    Window();
     ~Window();
 
     bool get_key(SDL_Scancode key);
 
     void process();
-    void update();
+    void update(const u32* lcd);
     bool open();
 
     float lerp(float a, float b, float t);
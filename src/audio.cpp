@@ -1,8 +1,7 @@
 #include "audio.hpp"
-#include <cmath>
-#include <vector>
+#include <algorithm>
 
-Audio::Audio(gmb::APU &apu) : apu(apu)
+Audio::Audio(gmb::APU &apu) : apu(apu), ring(apu.latency * AUDIO_CHANNELS * 4), playing(false), underruns(0), overruns(0)
 {
     SDL_Init(SDL_INIT_AUDIO);
 
@@ -12,11 +11,11 @@ Audio::Audio(gmb::APU &apu) : apu(apu)
     spec.format = AUDIO_FORMAT;
     spec.channels = AUDIO_CHANNELS;
     spec.samples = apu.latency;
-    spec.userdata = &apu;
-    spec.callback = nullptr;
+    spec.userdata = this;
+    spec.callback = callback;
 
+    /* stays paused until a buffer's worth is queued, see queue */
     device = SDL_OpenAudioDevice(nullptr, 0, &spec, nullptr, 0);
-    SDL_PauseAudioDevice(device, 0);
 }
 
 Audio::~Audio()
@@ -24,12 +23,50 @@ Audio::~Audio()
     SDL_CloseAudioDevice(device);
 }
 
-void Audio::queue(i16 *sample, usize length)
+void Audio::queue(const i16 *samples, usize length)
 {
-    SDL_QueueAudio(device, sample, length * sizeof(i16));
+    if (ring.write(samples, length) < length)
+        overruns++;
+
+    if (!playing && ring.size() >= apu.latency * AUDIO_CHANNELS)
+    {
+        SDL_PauseAudioDevice(device, 0);
+        playing = true;
+    }
+}
+
+void Audio::stop()
+{
+    /* held until queue has a buffer's worth again, rather than counting underruns while nothing is sent */
+    SDL_PauseAudioDevice(device, 1);
+    playing = false;
+
+    /* the callback can't run while paused, so what's left can go rather than play stale once queue starts it again */
+    ring.clear();
 }
 
 usize Audio::queued()
 {
-    return SDL_GetQueuedAudioSize(device) * sizeof(i16);
+    return ring.size();
+}
+
+f32 Audio::rate()
+{
+    /* dynamic rate control, a little more output while the queue is short of the latency & a little less past it */
+    f32 fill = std::clamp(ring.size() / f32(apu.latency * AUDIO_CHANNELS), 0.0f, 2.0f);
+    return 1 + max_deviation * (1 - fill);
+}
+
+void Audio::callback(void *userdata, u8 *stream, int length)
+{
+    Audio *audio = static_cast<Audio *>(userdata);
+    i16 *samples = reinterpret_cast<i16 *>(stream);
+    usize count = length / sizeof(i16);
+
+    usize read = audio->ring.read(samples, count);
+    if (read < count)
+    {
+        std::fill(samples + read, samples + count, 0);
+        audio->underruns++;
+    }
 }
@@ -3,10 +3,22 @@
 #include <cstdlib>
 #include <memory>
 #include <vector>
+#include <algorithm>
+#include <atomic>
+#include <thread>
 #include <filesystem>
 #include <core/dmg.hpp>
 #include "window.hpp"
 #include "audio.hpp"
+#include "triple_buffer.hpp"
+#include "pacer.hpp"
+#include "time_stretch.hpp"
+
+/* keys for up, down, left, right, b, a, start, select & turbo, a bit each in Gameboy::buttons */
+static const SDL_Scancode button_keys[] = {
+    SDL_SCANCODE_UP, SDL_SCANCODE_DOWN, SDL_SCANCODE_LEFT, SDL_SCANCODE_RIGHT,
+    SDL_SCANCODE_Z, SDL_SCANCODE_X, SDL_SCANCODE_RETURN, SDL_SCANCODE_BACKSPACE,
+    SDL_SCANCODE_SPACE};
 
 struct Gameboy
 {
@@ -15,15 +27,35 @@ struct Gameboy
 
     Window window;
     Audio audio_stream;
+    TripleBuffer frames;
+    Pacer pacer;
+    TimeStretch stretch; /* squeezes turbo's audio back down to real time */
 
     std::vector<i16> sample_buffer;
 
+    std::vector<i16> block; /* the apu mixes straight into this, & hands it to audio() each time it fills */
+    gmb_c::dmg_output_t output;
+
     bool turbo_active = false;
+    bool turbo_mute = false; /* skip mixing audio during turbo, rather than stretching it */
+    bool sync_audio = false; /* pace on the audio queue rather than the clock */
+    bool audio_fed = false; /* whether the apu handed over any audio during the last run */
 
-    Gameboy(const std::string &cart_path, const std::string &save_path, bool is_cgb)
-        : rom(cart_path, save_path), dmg(rom, is_cgb, 48000, 2048), window(dmg.ppu), audio_stream(dmg.apu)
+    /* shared between the emulation & presentation threads */
+    std::atomic<bool> running = true;
+    std::atomic<u16> buttons = 0;
+
+    Gameboy(const std::string &cart_path, const std::string &save_path, bool is_cgb, bool sync_audio, bool turbo_mute, usize latency)
+        : rom(cart_path, save_path), dmg(rom, is_cgb, 48000, latency), window(), audio_stream(dmg.apu), frames(LCD_WIDTH * LCD_HEIGHT),
+          stretch(dmg.apu.sample_rate), turbo_mute(turbo_mute), sync_audio(sync_audio)
     {
-        sample_buffer = std::vector<i16>(dmg.apu.latency * AUDIO_CHANNELS);
+        usize block_length = std::min<usize>(AUDIO_BLOCK, dmg.apu.latency);
+        sample_buffer.reserve(block_length * AUDIO_CHANNELS);
+
+        block = std::vector<i16>(block_length * AUDIO_CHANNELS);
+        dmg.apu.output(std::span<i16>(block), &Gameboy::audio_block, this);
+
+        output = {};
     }
 
     ~Gameboy()
@@ -33,68 +65,118 @@ struct Gameboy
 
     void set_turbo(bool turbo)
     {
+        if (turbo == turbo_active)
+            return;
+
         turbo_active = turbo;
+        dmg.core.ppu.frame_step = turbo ? SPEED_SHIFT : 1;
 
-        if (turbo)
+        if (turbo_mute)
         {
-            dmg.core.ppu.frame_step = SPEED_SHIFT;
+            /* the apu only keeps time while muted, which is most of what makes turbo cheap */
+            dmg.apu.mute(turbo);
+            if (turbo)
+                audio_stream.stop();
         }
         else
         {
-            dmg.core.ppu.frame_step = 1;
+            /* the apu renders at the speed it runs, & the stretch brings that back to real time */
+            stretch.reset();
+            stretch.tempo = turbo ? SPEED_SHIFT : 1;
         }
     }
 
     void run()
     {
+        /* the core runs on its own thread, this one only handles events & presents the newest frame */
+        std::thread emulation(&Gameboy::emulate, this);
+
         while (window.open())
+            present();
+
+        running = false;
+        emulation.join();
+
+        if (audio_stream.underruns || audio_stream.overruns)
+            std::cerr << "[!] audio: " << audio_stream.underruns << " underruns, " << audio_stream.overruns << " overruns" << std::endl;
+    }
+
+    void emulate()
+    {
+        while (running)
         {
-            dmg.cycle();
-            if (dmg.core.apu.update)
-                audio();
-            if (dmg.core.ppu.draw)
-                draw();
+            apply_buttons();
+
+            output.video = frames.write_buffer();
+            audio_fed = false;
+            usize cycles = dmg.run_frame(output);
+            dmg.apu.adjust_rate(audio_stream.rate());
+
+            if (output.drawn)
+                frames.publish();
+
+            /* the queue only paces while the apu is feeding a playing device, the clock does before it starts & with the apu off */
+            if (sync_audio && !turbo_active && audio_fed && audio_stream.playing)
+                pacer.wait_audio(audio_stream.queued() / AUDIO_CHANNELS, dmg.apu.latency, dmg.apu.sample_rate);
+            else
+                pacer.wait(cycles, turbo_active ? SPEED_SHIFT : 1);
         }
     }
 
-    void draw()
+    void present()
     {
         window.process();
 
         if (window.focused())
         {
-            dmg.core.mmu.buttons.up = window.get_key(SDL_SCANCODE_UP);
-            dmg.core.mmu.buttons.down = window.get_key(SDL_SCANCODE_DOWN);
-            dmg.core.mmu.buttons.left = window.get_key(SDL_SCANCODE_LEFT);
-            dmg.core.mmu.buttons.right = window.get_key(SDL_SCANCODE_RIGHT);
-            dmg.core.mmu.buttons.b = window.get_key(SDL_SCANCODE_Z);
-            dmg.core.mmu.buttons.a = window.get_key(SDL_SCANCODE_X);
-            dmg.core.mmu.buttons.start = window.get_key(SDL_SCANCODE_RETURN);
-            dmg.core.mmu.buttons.select = window.get_key(SDL_SCANCODE_BACKSPACE);
-            dmg.core.mmu.buttons.turbo = window.get_key(SDL_SCANCODE_SPACE);
-
-            set_turbo(dmg.core.mmu.buttons.turbo);
+            u16 pressed = 0;
+            for (usize i = 0; i < std::size(button_keys); i++)
+                pressed |= window.get_key(button_keys[i]) << i;
+
+            buttons = pressed;
         }
 
-        window.update();
+        if (frames.acquire())
+            window.update(frames.read_buffer());
+        else
+            SDL_Delay(1);
+    }
+
+    void apply_buttons()
+    {
+        u16 pressed = buttons;
+
+        dmg.core.mmu.buttons.up = pressed & (1 << 0);
+        dmg.core.mmu.buttons.down = pressed & (1 << 1);
+        dmg.core.mmu.buttons.left = pressed & (1 << 2);
+        dmg.core.mmu.buttons.right = pressed & (1 << 3);
+        dmg.core.mmu.buttons.b = pressed & (1 << 4);
+        dmg.core.mmu.buttons.a = pressed & (1 << 5);
+        dmg.core.mmu.buttons.start = pressed & (1 << 6);
+        dmg.core.mmu.buttons.select = pressed & (1 << 7);
+
+        set_turbo(pressed & (1 << 8));
     }
 
-    void audio()
+    static void audio_block(void *user, const void *samples, usize length)
     {
-        static float buffer_fill = 0;
-        sample_buffer[static_cast<usize>(buffer_fill * 2) + 0] = dmg.core.apu.output_left * 4;
-        sample_buffer[static_cast<usize>(buffer_fill * 2) + 1] = dmg.core.apu.output_right * 4;
+        static_cast<Gameboy *>(user)->audio(static_cast<const i16 *>(samples), length);
+    }
 
-        buffer_fill += 1.0f / (turbo_active ? SPEED_SHIFT : 1.0f);
+    void audio(const i16 *samples, usize count)
+    {
+        audio_fed = true;
+        sample_buffer.clear();
 
-        if (buffer_fill >= dmg.apu.latency)
-        {
-            buffer_fill = 0;
-            while (audio_stream.queued() > dmg.apu.latency * AUDIO_CHANNELS)
-            {
-            }
-            audio_stream.queue(&sample_buffer[0], dmg.apu.latency * AUDIO_CHANNELS);
-        }
+        if (turbo_active)
+            stretch.process(samples, count, sample_buffer);
+        else
+            sample_buffer.assign(samples, samples + count * AUDIO_CHANNELS);
+
+        for (i16 &sample : sample_buffer)
+            sample *= 4;
+
+        audio_stream.queue(sample_buffer.data(), sample_buffer.size());
     }
 };
 
@@ -102,8 +184,26 @@ int main(int argc, char *argv[])
 {
     std::filesystem::path cart_path, save_path;
     bool is_cgb = false;
+    bool sync_audio = false;
+    bool turbo_mute = false;
+    usize latency = 2048;
+
+    bool valid = argc >= 2;
+    for (int i = 2; valid && i < argc; i++)
+    {
+        std::string option = argv[i];
+
+        if (option == "--sync-audio")
+            sync_audio = true;
+        else if (option == "--turbo-mute")
+            turbo_mute = true;
+        else if (option == "--latency" && i + 1 < argc)
+            latency = std::max(std::stoul(argv[++i]), 64UL);
+        else
+            valid = false;
+    }
 
-    if (argc == 2)
+    if (valid)
     {
         cart_path = std::string(argv[1]);
         save_path = std::filesystem::path(std::string(argv[1]))
@@ -112,11 +212,11 @@ int main(int argc, char *argv[])
     }
     else
     {
-        std::cerr << "[!] usage: gameboy <rom_path>" << std::endl;
+        std::cerr << "[!] usage: gameboy <rom_path> [--sync-audio] [--turbo-mute] [--latency <samples>]" << std::endl;
         return EXIT_FAILURE;
     }
 
-    Gameboy gb(cart_path.string(), save_path.string(), is_cgb);
+    Gameboy gb(cart_path.string(), save_path.string(), is_cgb, sync_audio, turbo_mute, latency);
     gb.run();
     return EXIT_SUCCESS;
 }
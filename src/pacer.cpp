@@ -0,0 +1,46 @@
+#include "pacer.hpp"
+
+#include <thread>
+#include <core/dmg.hpp>
+
+Pacer::Pacer()
+{
+    reset();
+}
+
+void Pacer::reset()
+{
+    deadline = clock::now();
+}
+
+void Pacer::wait(usize cycles, usize speed)
+{
+    /* the deadline moves by emulated time, so rounding never builds up into drift */
+    deadline += std::chrono::nanoseconds(cycles * 1000000000ULL / (CPU_FREQUENCY * speed));
+
+    if (clock::now() - deadline > max_lag)
+    {
+        reset();
+        return;
+    }
+
+    sleep_until(deadline);
+}
+
+void Pacer::wait_audio(usize queued, usize target, usize sample_rate)
+{
+    /* sleep off whatever's queued past the target, the device drains it at the sample rate */
+    reset();
+
+    if (queued > target)
+        sleep_until(deadline + std::chrono::nanoseconds((queued - target) * 1000000000ULL / sample_rate));
+}
+
+void Pacer::sleep_until(clock::time_point time)
+{
+    if (time - clock::now() > spin_margin)
+        std::this_thread::sleep_until(time - spin_margin);
+
+    while (clock::now() < time)
+        std::this_thread::yield();
+}
@@ -0,0 +1,58 @@
+#include "ring_buffer.hpp"
+
+#include <algorithm>
+
+RingBuffer::RingBuffer(usize capacity) : head(0), tail(0)
+{
+    usize size = 1;
+    while (size < capacity)
+        size <<= 1;
+
+    samples = std::make_unique<i16[]>(size);
+    mask = size - 1;
+}
+
+usize RingBuffer::capacity()
+{
+    return mask + 1;
+}
+
+usize RingBuffer::size()
+{
+    return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+}
+
+usize RingBuffer::write(const i16* data, usize count)
+{
+    usize position = head.load(std::memory_order_relaxed);
+    usize free = capacity() - (position - tail.load(std::memory_order_acquire));
+    count = std::min(count, free);
+
+    /* in up to two runs, either side of the wrap */
+    usize first = std::min(count, capacity() - (position & mask));
+    std::copy(data, data + first, &samples[position & mask]);
+    std::copy(data + first, data + count, &samples[0]);
+
+    head.store(position + count, std::memory_order_release);
+    return count;
+}
+
+usize RingBuffer::read(i16* data, usize count)
+{
+    usize position = tail.load(std::memory_order_relaxed);
+    usize available = head.load(std::memory_order_acquire) - position;
+    count = std::min(count, available);
+
+    usize first = std::min(count, capacity() - (position & mask));
+    std::copy(&samples[position & mask], &samples[position & mask] + first, data);
+    std::copy(&samples[0], &samples[0] + (count - first), data + first);
+
+    tail.store(position + count, std::memory_order_release);
+    return count;
+}
+
+void RingBuffer::clear()
+{
+    /* drops everything written so far by catching the tail up to the head, which the producer is free to keep moving */
+    tail.store(head.load(std::memory_order_acquire), std::memory_order_release);
+}
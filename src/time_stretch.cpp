@@ -0,0 +1,96 @@
+#include "time_stretch.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+TimeStretch::TimeStretch(usize sample_rate)
+    : sequence(sample_rate * 40 / 1000), overlap(sample_rate * 8 / 1000), seek(sample_rate * 15 / 1000)
+{
+    reset();
+}
+
+void TimeStretch::reset()
+{
+    /* the first sequence fades in from silence */
+    input.clear();
+    tail.assign(overlap * 2, 0);
+    position = 0;
+}
+
+void TimeStretch::process(const i16 *samples, usize length, std::vector<i16> &output)
+{
+    input.insert(input.end(), samples, samples + length * 2);
+
+    while (usize(position) + seek + sequence <= input.size() / 2)
+    {
+        usize start = usize(position) + best_offset(usize(position));
+        const i16 *from = &input[start * 2];
+
+        /* crossfade out of the last sequence's tail & into this one */
+        for (usize i = 0; i < overlap; i++)
+        {
+            f32 fade = f32(i) / overlap;
+            for (usize channel = 0; channel < 2; channel++)
+                output.push_back(i16(tail[i * 2 + channel] * (1 - fade) + from[i * 2 + channel] * fade));
+        }
+
+        output.insert(output.end(), from + overlap * 2, from + (sequence - overlap) * 2);
+        tail.assign(from + (sequence - overlap) * 2, from + sequence * 2);
+
+        /* sequence - overlap came out, tempo times as much goes in */
+        position += (sequence - overlap) * tempo;
+
+        /* which can be further than what's come in yet, the rest is skipped as it arrives */
+        usize consumed = std::min<usize>(usize(position), input.size() / 2);
+        input.erase(input.begin(), input.begin() + consumed * 2);
+        position -= consumed;
+    }
+}
+
+usize TimeStretch::best_offset(usize start)
+{
+    /* every fourth offset on every other sample first, then every offset close to the best of those */
+    usize best = 0;
+    f32 best_score = -INFINITY;
+
+    for (usize offset = 0; offset < seek; offset += 4)
+    {
+        f32 score = correlation(start + offset, 2);
+        if (score > best_score)
+        {
+            best_score = score;
+            best = offset;
+        }
+    }
+
+    /* the coarse scores only cover half the samples, so they don't compare with the fine ones */
+    usize coarse = best;
+    best_score = -INFINITY;
+    for (usize offset = coarse > 3 ? coarse - 3 : 0; offset <= std::min(coarse + 3, seek - 1); offset++)
+    {
+        f32 score = correlation(start + offset, 1);
+        if (score > best_score)
+        {
+            best_score = score;
+            best = offset;
+        }
+    }
+
+    return best;
+}
+
+f32 TimeStretch::correlation(usize start, usize step)
+{
+    /* of the tail & the candidate, mixed down to mono & normalised by the candidate's energy */
+    f32 product = 0, energy = 0;
+
+    for (usize i = 0; i < overlap; i += step)
+    {
+        f32 a = f32(tail[i * 2]) + tail[i * 2 + 1];
+        f32 b = f32(input[(start + i) * 2]) + input[(start + i) * 2 + 1];
+        product += a * b;
+        energy += b * b;
+    }
+
+    return product / std::sqrt(energy + 1);
+}
@@ -0,0 +1,33 @@
+#include "triple_buffer.hpp"
+
+TripleBuffer::TripleBuffer(usize size) : shared(1), back(0), front(2)
+{
+    for (auto& buffer : buffers)
+        buffer = std::make_unique<u32[]>(size);
+}
+
+u32* TripleBuffer::write_buffer()
+{
+    return buffers[back].get();
+}
+
+void TripleBuffer::publish()
+{
+    /* swap the finished frame into the middle, & carry on in whichever buffer was there */
+    back = shared.exchange(back | fresh, std::memory_order_acq_rel) & ~fresh;
+}
+
+bool TripleBuffer::acquire()
+{
+    if (!(shared.load(std::memory_order_acquire) & fresh))
+        return false;
+
+    /* frames published since the check are picked up too, only the newest is ever shown */
+    front = shared.exchange(front, std::memory_order_acq_rel) & ~fresh;
+    return true;
+}
+
+const u32* TripleBuffer::read_buffer()
+{
+    return buffers[front].get();
+}
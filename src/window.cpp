@@ -2,11 +2,11 @@
 
 #include <cmath>
 
-Window::Window(gmb::PPU &ppu) : ppu(ppu)
+Window::Window()
 {
     SDL_Init(SDL_INIT_VIDEO);
     handle = SDL_CreateWindow("gameboy", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, window_width, window_height, SDL_WINDOW_RESIZABLE | SDL_WINDOW_ALLOW_HIGHDPI);
-    renderer = SDL_CreateRenderer(handle, -1, SDL_RENDERER_ACCELERATED);
+    renderer = SDL_CreateRenderer(handle, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
     texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ABGR8888, SDL_TEXTUREACCESS_STREAMING, lcd_width, lcd_height);
 
     SDL_RenderSetLogicalSize(renderer, lcd_width, lcd_height);
@@ -44,11 +44,11 @@ void Window::process()
     keys = reinterpret_cast<const u8 *>(SDL_GetKeyboardState(NULL));
 }
 
-void Window::update()
+void Window::update(const u32 *lcd)
 {
     for (usize i = 0; i < lcd_width * lcd_height; i++)
     {
-        pixels.get()[i] = shader(ppu.core.ppu.lcd[i]);
+        pixels.get()[i] = shader(lcd[i]);
     }
 
     SDL_UpdateTexture(texture, NULL, pixels.get(), lcd_width * sizeof(u32));
@@ -56,17 +56,6 @@ void Window::update()
     SDL_RenderClear(renderer);
     SDL_RenderCopy(renderer, texture, NULL, NULL);
     SDL_RenderPresent(renderer);
-
-    while (true)
-    {
-        u32 delta = SDL_GetTicks() - last_time;
-
-        if (delta > 1000 / 60.0)
-        {
-            last_time = SDL_GetTicks();
-            break;
-        }
-    }
 }
 
 bool Window::open()